@@ -8,8 +8,15 @@ This was written based on the tzfile.5 manpage, from man-pages 3.01.
 __author__ = 'Ohad Lutzky <ohad@lutzky.net>'
 
 import sys
+import os
 import struct
 import time
+import hashlib
+import json
+import csv
+import multiprocessing
+from collections import OrderedDict
+from optparse import OptionParser
 from pprint import pprint
 
 class TZType:
@@ -29,14 +36,16 @@ class TZFile:
     def __init__(self, filename):
         self.cached_types = None
 
-        f = open(sys.argv[1])
+        f = open(filename, "rb")
 
         header_magic, \
                 self.ttisgmtcnt, self.ttisstdcnt, self.leapcnt, \
                 self.timecnt, self.typecnt, self.charcnt = \
                 struct.unpack(">4s16x6l", f.read(44))
 
-        if header_magic != "TZif": raise "Bad header magic"
+        if header_magic != "TZif":
+            f.close()
+            raise ValueError("%s: bad header magic" % filename)
 
         self.transitions = zip(
                 struct.unpack(">%dl" % self.timecnt, f.read(4 * self.timecnt)),
@@ -101,8 +110,101 @@ class TZFile:
                 (time.ctime(transition[0]), transition[1].abbr)
                 for transition in self.get_transitions() ]
 
+def find_zones(tzdir):
+    """find_zones(tzdir) -> list of name lists
+
+    Walk tzdir and group the files in it that are the same zone: first
+    by inode, so hard links and symbolic links are only read once, then
+    by content hash. Each group is sorted by name, and the groups by
+    their first name."""
+
+    by_inode = {}
+    for dirpath, dirnames, filenames in os.walk(tzdir):
+        dirnames.sort()
+        for filename in filenames:
+            path = os.path.join(dirpath, filename)
+            try:
+                st = os.stat(path)
+            except OSError:
+                continue
+            name = os.path.relpath(path, tzdir)
+            by_inode.setdefault((st.st_dev, st.st_ino), []).append(name)
+
+    by_hash = {}
+    for names in by_inode.values():
+        f = open(os.path.join(tzdir, names[0]), "rb")
+        try:
+            digest = hashlib.sha1(f.read()).hexdigest()
+        finally:
+            f.close()
+        by_hash.setdefault(digest, []).extend(names)
+
+    return sorted(sorted(names) for names in by_hash.values())
+
+def dump_zone(args):
+    """dump_zone((tzdir, names)) -> (names, transitions) or None
+
+    Parse one zone for dump_tree; runs in a worker process. Returns None
+    for files that are not zoneinfo files."""
+
+    tzdir, names = args
+    try:
+        tz = TZFile(os.path.join(tzdir, names[0]))
+    except (ValueError, struct.error, IOError):
+        return None
+    return names, [ (when, tztype.offset, tztype.is_dst, tztype.abbr)
+                    for when, tztype in tz.get_transitions() ]
+
+CSV_FIELDS = [ "zone", "aliases", "time", "utc", "offset", "isdst", "abbr" ]
+
+def dump_tree(tzdir, out, format="jsonl", processes=None):
+    """Dump every transition of every zone under tzdir to out, one record
+    per line, as JSON lines or CSV. Identical zones are dumped once, under
+    their first name, with the others listed as aliases."""
+
+    if format == "csv":
+        writer = csv.writer(out)
+        writer.writerow(CSV_FIELDS)
+        write = lambda record: writer.writerow(record)
+    else:
+        write = lambda record: out.write(
+                json.dumps(OrderedDict(zip(CSV_FIELDS, record))) + "\n")
+
+    pool = multiprocessing.Pool(processes)
+    try:
+        zones = [ (tzdir, names) for names in find_zones(tzdir) ]
+        for result in pool.imap(dump_zone, zones, chunksize=8):
+            if result is None:
+                continue
+            names, transitions = result
+            aliases = ";".join(names[1:])
+            for when, offset, is_dst, abbr in transitions:
+                utc = time.strftime("%Y-%m-%dT%H:%M:%SZ", time.gmtime(when))
+                write((names[0], aliases, when, utc, offset, int(is_dst),
+                       abbr))
+    finally:
+        pool.close()
+        pool.join()
+
 if __name__ == '__main__':
-        my_tzfile = TZFile(sys.argv[1])
+        parser = OptionParser(usage="%prog FILE\n"
+                              "       %prog -r TZDIR [-f jsonl|csv] [-j N]")
+        parser.add_option("-r", "--tree", metavar="TZDIR",
+                          help="dump every zone under TZDIR")
+        parser.add_option("-f", "--format", default="jsonl",
+                          choices=["jsonl", "csv"],
+                          help="output format for -r: jsonl or csv")
+        parser.add_option("-j", "--jobs", type="int",
+                          help="worker processes for -r (default: CPUs)")
+        options, args = parser.parse_args()
+
+        if options.tree:
+            dump_tree(options.tree, sys.stdout, options.format, options.jobs)
+            sys.exit(0)
+        if len(args) != 1:
+            parser.error("expected one zone file")
+
+        my_tzfile = TZFile(args[0])
 
         print "Transitions:"
         pprint(my_tzfile.formatted_transitions())
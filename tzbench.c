@@ -0,0 +1,1188 @@
+/* Benchmarks for the tzfile reader.
+
+   It is built with the reader, and times its internal search routines
+   through tzzone-internal.h:
+
+	cc -O2 -o tzbench tzbench.c tzzone.c -lpthread
+
+   Usage: tzbench [-j] MODE [TZDIR]
+
+   MODE is one of
+     layout	sorted against Eytzinger transition search, and against
+		the direct index of tz_zone_set_index
+     memory	bytes per zone as mapped and as compact copies, and the
+		time of a lookup among the transitions of each; then the
+		whole tree opened, with what sharing zones saved
+     load	__tzfile_read over every file: cold, warm and unchanged;
+		then tz_zone_open_window for 2020 through 2029; then
+		the whole tree cold, zone by zone and with tz_preload
+     compute	__tzfile_compute by code path, against glibc localtime_r;
+		then with tz_breakdown, one at a time and in batches
+     format	log timestamps in RFC 3339 with milliseconds: tz_format
+		one at a time and in batches, against localtime_r and
+		strftime
+     scale	tz_zone_lookup, __tzfile_compute and localtime_r in
+		1, 2, 4 ... threads at once, up to the number of CPUs
+     all	load and compute
+
+   TZDIR defaults to the directory the library looks zones up in: $TZDIR
+   or else the one compiled in.
+
+   The load, compute and format modes report ns/op, the median and 99th
+   percentile of samples of SAMPLE_OPS operations, and allocations per
+   operation.  With -j they, and the memory and scale modes, print one
+   JSON object per line instead.  */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tzzone-internal.h"
+
+#define LOOKUPS 200000
+
+static const char *bench_tzdir;
+static int bench_json;
+
+static double
+now_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Allocation counting.  Everything, libc included, allocates through
+   these, which hand on to glibc's own allocator.  */
+
+extern void *__libc_malloc (size_t);
+extern void *__libc_calloc (size_t, size_t);
+extern void *__libc_realloc (void *, size_t);
+extern void *__libc_memalign (size_t, size_t);
+
+static size_t bench_allocs;
+
+void *
+malloc (size_t size)
+{
+  __atomic_add_fetch (&bench_allocs, 1, __ATOMIC_RELAXED);
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t n, size_t size)
+{
+  __atomic_add_fetch (&bench_allocs, 1, __ATOMIC_RELAXED);
+  return __libc_calloc (n, size);
+}
+
+void *
+realloc (void *p, size_t size)
+{
+  __atomic_add_fetch (&bench_allocs, 1, __ATOMIC_RELAXED);
+  return __libc_realloc (p, size);
+}
+
+void *
+aligned_alloc (size_t align, size_t size)
+{
+  __atomic_add_fetch (&bench_allocs, 1, __ATOMIC_RELAXED);
+  return __libc_memalign (align, size);
+}
+
+static size_t
+allocs_now (void)
+{
+  return __atomic_load_n (&bench_allocs, __ATOMIC_RELAXED);
+}
+
+/* Classic binary search over the sorted, decoded transition times, as
+   __tzfile_compute did before the Eytzinger layout.  It is not inlined,
+   so that it is called as __tzfile_search is.  */
+static __attribute__ ((noinline)) size_t
+sorted_search (const time_t *sorted, size_t n, time_t timer)
+{
+  size_t lo = 0, hi = n - 1;
+
+  while (lo + 1 < hi)
+    {
+      size_t i = (lo + hi) / 2;
+
+      if (timer < sorted[i])
+	hi = i;
+      else
+	lo = i;
+    }
+  return hi;
+}
+
+/* Layout comparison.  Totals over all zones, and over the zones with
+   long histories where cache behaviour matters most.  */
+
+struct layout_totals
+{
+  size_t zones;
+  double sorted_ns, eytz_ns, index_ns;
+  size_t index_bytes;
+};
+
+static struct layout_totals layout_all, layout_long;
+static time_t *layout_in;
+static size_t layout_sink;
+
+static int
+layout_one (const char *path, const struct stat *sb, int flag,
+	    struct FTW *ftw)
+{
+  struct tz_zone *zone;
+  struct tz_memory_stats ms;
+  time_t *sorted, first, last;
+  size_t i, n;
+  double t0, t1, t2, t3;
+
+  if (flag != FTW_F)
+    return 0;
+  zone = tzfile_load (path, 0, NULL, 1, NULL);
+  if (zone == NULL)
+    return 0;
+  n = zone->num_transitions;
+  if (n < 2)
+    {
+      tzfile_free (zone);
+      return 0;
+    }
+
+  sorted = malloc (n * sizeof (time_t));
+  for (i = 0; i < n; ++i)
+    sorted[i] = zone_transition (zone, i);
+  first = sorted[0];
+  last = sorted[n - 1];
+  for (i = 0; i < LOOKUPS; ++i)
+    layout_in[i] = first + (time_t) (drand48 () * (double) (last - first));
+
+  t0 = now_ns ();
+  for (i = 0; i < LOOKUPS; ++i)
+    layout_sink += sorted_search (sorted, n, layout_in[i]);
+  t1 = now_ns ();
+  for (i = 0; i < LOOKUPS; ++i)
+    layout_sink += __tzfile_search (zone, layout_in[i]);
+  t2 = now_ns ();
+  /* Build the index before timing it.  */
+  tz_zone_set_index (zone, TZ_INDEX_SHIFT_DEFAULT);
+  layout_sink += __tzfile_search (zone, first);
+  t3 = now_ns ();
+  for (i = 0; i < LOOKUPS; ++i)
+    layout_sink += __tzfile_search (zone, layout_in[i]);
+  t3 = now_ns () - t3;
+  tz_memory_stats (zone, &ms);
+
+  layout_all.zones++;
+  layout_all.sorted_ns += t1 - t0;
+  layout_all.eytz_ns += t2 - t1;
+  layout_all.index_ns += t3;
+  layout_all.index_bytes += ms.index;
+  if (n >= 200)
+    {
+      layout_long.zones++;
+      layout_long.sorted_ns += t1 - t0;
+      layout_long.eytz_ns += t2 - t1;
+      layout_long.index_ns += t3;
+      layout_long.index_bytes += ms.index;
+    }
+
+  free (sorted);
+  tzfile_free (zone);
+  return 0;
+}
+
+static void
+layout_report (const char *what, const struct layout_totals *t)
+{
+  double lookups = (double) t->zones * LOOKUPS;
+
+  if (t->zones == 0)
+    return;
+  printf ("%-28s %5zu zones  sorted %6.1f ns/op  eytzinger %6.1f ns/op  "
+	  "index %6.1f ns/op, %zu bytes/zone\n",
+	  what, t->zones, t->sorted_ns / lookups, t->eytz_ns / lookups,
+	  t->index_ns / lookups, t->index_bytes / t->zones);
+}
+
+static int
+bench_layout (void)
+{
+  layout_in = malloc (LOOKUPS * sizeof (time_t));
+  srand48 (1);
+  if (nftw (bench_tzdir, layout_one, 16, FTW_PHYS) != 0)
+    {
+      perror (bench_tzdir);
+      return 1;
+    }
+  layout_report ("all zones", &layout_all);
+  layout_report (">= 200 transitions", &layout_long);
+  free (layout_in);
+  return layout_sink == 0;
+}
+
+/* Name of PATH relative to the benchmarked tree, as __tzfile_read
+   wants it.  */
+static const char *
+bench_name (const char *path)
+{
+  const char *name = path + strlen (bench_tzdir);
+
+  while (*name == '/')
+    ++name;
+  return name;
+}
+
+/* Zone files of the benchmarked tree, as the load and memory modes
+   find them.  */
+static char **tree_paths;
+static size_t tree_num_paths, tree_max_paths;
+
+static void
+tree_add (const char *path)
+{
+  if (tree_num_paths == tree_max_paths)
+    {
+      tree_max_paths = tree_max_paths * 2 + 256;
+      tree_paths = realloc (tree_paths, tree_max_paths * sizeof (char *));
+      if (tree_paths == NULL)
+	{
+	  perror ("tzbench");
+	  exit (1);
+	}
+    }
+  tree_paths[tree_num_paths++] = strdup (path);
+}
+
+/* Memory.  Each zone as tzfile_load leaves it, with its file mapped,
+   and as a compact copy: the bytes each takes, by what for, and the
+   time of a lookup among its transitions.  */
+
+#define MEMORY_LOOKUPS 20000
+
+struct memory_totals
+{
+  const char *name;
+  size_t zones;
+  struct tz_memory_stats sum;
+  double lookup_ns;
+  size_t lookups;
+};
+
+static struct memory_totals memory_mapped = { "mapped" };
+static struct memory_totals memory_compact = { "compact" };
+
+static void
+memory_add (struct memory_totals *t, struct tz_zone *zone,
+	    const time_t *in, size_t n)
+{
+  struct tz_memory_stats st;
+  struct tz_lookup result;
+  double t0;
+  size_t i;
+
+  tz_memory_stats (zone, &st);
+  t->zones++;
+  t->sum.zone += st.zone;
+  t->sum.mapped += st.mapped;
+  t->sum.search += st.search;
+  t->sum.names += st.names;
+  t->sum.compact += st.compact;
+  t->sum.rules += st.rules;
+  t->sum.strings += st.strings;
+  t->sum.total += st.total;
+
+  t0 = now_ns ();
+  for (i = 0; i < n; ++i)
+    {
+      tz_zone_lookup (zone, in[i], &result);
+      layout_sink += result.gmtoff;
+    }
+  t->lookup_ns += now_ns () - t0;
+  t->lookups += n;
+}
+
+static int
+memory_one (const char *path, const struct stat *sb, int flag,
+	    struct FTW *ftw)
+{
+  struct tz_zone *zone, *compact;
+  time_t first, last;
+  size_t i, n = 0;
+
+  /* Links are names too, for memory_shared.  */
+  if (flag == FTW_SL)
+    tree_add (path);
+  if (flag != FTW_F)
+    return 0;
+  zone = tzfile_load (path, 0, NULL, 1, NULL);
+  if (zone == NULL)
+    return 0;
+  compact = tz_zone_compact (zone);
+  if (compact == NULL)
+    {
+      perror ("tz_zone_compact");
+      tzfile_free (zone);
+      return 1;
+    }
+
+  /* Sizes first, before the lookups work out any rule years.  */
+  if (zone->num_transitions >= 2)
+    {
+      n = MEMORY_LOOKUPS;
+      first = zone_transition (zone, 0);
+      last = zone_transition (zone, zone->num_transitions - 1);
+      for (i = 0; i < n; ++i)
+	layout_in[i] = first + (time_t) (drand48 () * (double) (last - first));
+    }
+  memory_add (&memory_mapped, zone, layout_in, n);
+  memory_add (&memory_compact, compact, layout_in, n);
+
+  tz_zone_close (compact);
+  tzfile_free (zone);
+  tree_add (path);
+  return 0;
+}
+
+static void
+memory_report (const struct memory_totals *t)
+{
+  const struct tz_memory_stats *s = &t->sum;
+  double ns = t->lookups == 0 ? 0 : t->lookup_ns / t->lookups;
+
+  if (bench_json)
+    printf ("{\"layout\":\"%s\",\"zones\":%zu,\"zone\":%zu,\"mapped\":%zu,"
+	    "\"search\":%zu,\"names\":%zu,\"compact\":%zu,\"rules\":%zu,"
+	    "\"strings\":%zu,\"total\":%zu,\"lookup_ns\":%.2f}\n",
+	    t->name, t->zones, s->zone, s->mapped, s->search, s->names,
+	    s->compact, s->rules, s->strings, s->total, ns);
+  else
+    printf ("%-8s %5zu %8zu %8zu %8zu %8zu %8zu %8zu %8zu %9zu %8.1f\n",
+	    t->name, t->zones, s->zone, s->mapped, s->search, s->names,
+	    s->compact, s->rules, s->strings, s->total, ns);
+}
+
+/* Then every zone file and symbolic link opened through the registry,
+   where names holding the same zone share it: zones and names, the
+   bytes the zones hold, counting each once, and the bytes the sharing
+   saved.  */
+static void
+memory_shared (void)
+{
+  struct tz_dedup_stats st;
+  struct tz_memory_stats ms;
+  const char **names;
+  struct tz_zone **zones;
+  size_t i, j, total = 0;
+
+  names = calloc (tree_num_paths, sizeof *names);
+  zones = calloc (tree_num_paths, sizeof *zones);
+  if (names == NULL || zones == NULL)
+    {
+      perror ("tzbench");
+      exit (1);
+    }
+  for (i = 0; i < tree_num_paths; ++i)
+    names[i] = bench_name (tree_paths[i]);
+  tz_preload (names, tree_num_paths, zones);
+  tz_dedup_stats (&st);
+  for (i = 0; i < tree_num_paths; ++i)
+    {
+      for (j = 0; j < i && zones[j] != zones[i]; ++j)
+	;
+      if (zones[i] != NULL && j == i)
+	{
+	  tz_memory_stats (zones[i], &ms);
+	  total += ms.total;
+	}
+    }
+
+  if (bench_json)
+    printf ("{\"layout\":\"shared\",\"zones\":%zu,\"names\":%zu,"
+	    "\"total\":%zu,\"saved\":%zu}\n",
+	    st.zones, st.zones + st.aliases, total, st.saved);
+  else
+    printf ("shared: %zu zones for %zu names hold %zu bytes; sharing "
+	    "saved %zu (%.1f%%)\n", st.zones, st.zones + st.aliases, total,
+	    st.saved, 100.0 * st.saved / (total + st.saved));
+
+  for (i = 0; i < tree_num_paths; ++i)
+    tz_zone_close (zones[i]);
+  free (zones);
+  free (names);
+}
+
+static int
+bench_memory (void)
+{
+  layout_in = malloc (MEMORY_LOOKUPS * sizeof (time_t));
+  srand48 (1);
+  if (nftw (bench_tzdir, memory_one, 16, FTW_PHYS) != 0)
+    {
+      perror (bench_tzdir);
+      return 1;
+    }
+  if (!bench_json)
+    printf ("%-8s %5s %8s %8s %8s %8s %8s %8s %8s %9s %8s\n", "layout",
+	    "zones", "zone", "mapped", "search", "names", "compact", "rules",
+	    "strings", "total", "ns/op");
+  memory_report (&memory_mapped);
+  memory_report (&memory_compact);
+  memory_shared ();
+  free (layout_in);
+  return 0;
+}
+
+/* Timed cases.  Each sample is the mean ns/op of a few operations, so
+   that clock overhead stays small against what is measured.  */
+
+#define SAMPLE_OPS 32
+#define ZONE_SAMPLES 64
+
+enum
+  {
+    CASE_LOAD_COLD,
+    CASE_LOAD_WARM,
+    CASE_LOAD_SAME,
+    CASE_LOAD_WINDOW,
+    CASE_LOAD_OPEN_ALL,
+    CASE_LOAD_PRELOAD,
+    CASE_BEFORE,
+    CASE_SEARCH_SHORT,
+    CASE_SEARCH_LONG,
+    CASE_RULES,
+    CASE_LEAP,
+    CASE_LOCALTIME,
+    CASE_LOCALTIME_BATCH,
+    CASE_FORMAT,
+    CASE_FORMAT_BATCH,
+    CASES
+  };
+
+/* Zones with fewer transitions than this count as short histories,
+   whose search tree fits in a few cache lines.  */
+#define SHORT_HISTORY 64
+
+struct bench_case
+{
+  const char *name;
+  double *samples;		/* ns/op of each sample.  */
+  size_t num_samples, max_samples;
+  double total_ns;
+  size_t ops, allocs;
+};
+
+/* Ours, and glibc's localtime_r on the same inputs.  */
+static struct bench_case cases[CASES] =
+  {
+    { "load/cold" }, { "load/warm" }, { "load/unchanged" },
+    { "load/window" }, { "load/open-all" }, { "load/preload" },
+    { "compute/before" }, { "compute/search-short" },
+    { "compute/search-long" }, { "compute/rules" }, { "compute/leap" },
+    { "compute/localtime" }, { "compute/localtime-batch" },
+    { "format/one" }, { "format/batch" }
+  };
+static struct bench_case glibc_cases[CASES];
+
+static size_t bench_sink;
+
+static void
+case_add (struct bench_case *c, double ns, size_t ops, size_t allocs)
+{
+  if (c->num_samples == c->max_samples)
+    {
+      c->max_samples = c->max_samples * 2 + 1024;
+      c->samples = __libc_realloc (c->samples,
+				   c->max_samples * sizeof (double));
+      if (c->samples == NULL)
+	{
+	  perror ("tzbench");
+	  exit (1);
+	}
+    }
+  c->samples[c->num_samples++] = ns / ops;
+  c->total_ns += ns;
+  c->ops += ops;
+  c->allocs += allocs;
+}
+
+static int
+double_compare (const void *a, const void *b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+
+  return x < y ? -1 : x > y;
+}
+
+static void
+case_report (const struct bench_case *c, const char *prefix)
+{
+  double p50, p99;
+
+  if (c->num_samples == 0)
+    return;
+  qsort (c->samples, c->num_samples, sizeof (double), double_compare);
+  p50 = c->samples[c->num_samples / 2];
+  p99 = c->samples[(size_t) (c->num_samples * 0.99)];
+
+  if (bench_json)
+    printf ("{\"case\":\"%s%s\",\"ops\":%zu,\"ns_per_op\":%.2f,"
+	    "\"p50_ns\":%.2f,\"p99_ns\":%.2f,\"allocs_per_op\":%.3f}\n",
+	    prefix, c->name, c->ops, c->total_ns / c->ops, p50, p99,
+	    (double) c->allocs / c->ops);
+  else
+    printf ("%-6s %-22s %9zu %10.1f %10.1f %10.1f %10.3f\n",
+	    prefix[0] == '\0' ? "ours" : "glibc", c->name, c->ops,
+	    c->total_ns / c->ops, p50, p99, (double) c->allocs / c->ops);
+}
+
+static void
+report_header (void)
+{
+  if (!bench_json)
+    printf ("%-6s %-22s %9s %10s %10s %10s %10s\n", "impl", "case", "ops",
+	    "ns/op", "p50", "p99", "allocs/op");
+}
+
+/* Loading.  For each file: first with its pages dropped from the page
+   cache, then again from the page cache, then once more with the file
+   unchanged, which __tzfile_read notices without reading it.  Last, a
+   windowed load from the page cache, closed again untimed.  Then the
+   whole tree at once, with every file dropped from the page cache
+   first: opened one zone after another with tz_zone_open, and all
+   together with tz_preload.  Both report the time per zone.  */
+
+static void
+evict (const char *path)
+{
+  int fd = open (path, O_RDONLY | O_CLOEXEC);
+
+  if (fd >= 0)
+    {
+      posix_fadvise (fd, 0, 0, POSIX_FADV_DONTNEED);
+      close (fd);
+    }
+}
+
+static int
+load_one (const char *path, const struct stat *sb, int flag,
+	  struct FTW *ftw)
+{
+  const char *name = bench_name (path);
+  struct tz_zone *zone;
+  size_t a0;
+  double t0;
+
+  if (flag != FTW_F)
+    return 0;
+
+  evict (path);
+  __use_tzfile = 0;
+  a0 = allocs_now ();
+  t0 = now_ns ();
+  __tzfile_read (name, 0, NULL);
+  if (!__use_tzfile)
+    /* Not a zone file.  */
+    return 0;
+  case_add (&cases[CASE_LOAD_COLD], now_ns () - t0, 1, allocs_now () - a0);
+
+  __use_tzfile = 0;
+  a0 = allocs_now ();
+  t0 = now_ns ();
+  __tzfile_read (name, 0, NULL);
+  case_add (&cases[CASE_LOAD_WARM], now_ns () - t0, 1, allocs_now () - a0);
+
+  a0 = allocs_now ();
+  t0 = now_ns ();
+  __tzfile_read (name, 0, NULL);
+  case_add (&cases[CASE_LOAD_SAME], now_ns () - t0, 1, allocs_now () - a0);
+
+  a0 = allocs_now ();
+  t0 = now_ns ();
+  zone = tz_zone_open_window (name, year_start (2020), year_start (2030));
+  case_add (&cases[CASE_LOAD_WINDOW], now_ns () - t0, 1, allocs_now () - a0);
+  tz_zone_close (zone);
+
+  tree_add (path);
+  return 0;
+}
+
+/* Time opening every zone of the tree cold, one after another if
+   !PRELOAD, else with tz_preload, and close them again untimed.  */
+static void
+load_all (int preload)
+{
+  const char **names;
+  struct tz_zone **zones;
+  size_t i, a0;
+  double t0;
+
+  names = calloc (tree_num_paths, sizeof *names);
+  zones = calloc (tree_num_paths, sizeof *zones);
+  if (names == NULL || zones == NULL)
+    {
+      perror ("tzbench");
+      exit (1);
+    }
+  for (i = 0; i < tree_num_paths; ++i)
+    {
+      evict (tree_paths[i]);
+      names[i] = bench_name (tree_paths[i]);
+    }
+
+  a0 = allocs_now ();
+  t0 = now_ns ();
+  if (preload)
+    tz_preload (names, tree_num_paths, zones);
+  else
+    for (i = 0; i < tree_num_paths; ++i)
+      zones[i] = tz_zone_open (names[i]);
+  case_add (&cases[preload ? CASE_LOAD_PRELOAD : CASE_LOAD_OPEN_ALL],
+	    now_ns () - t0, tree_num_paths, allocs_now () - a0);
+
+  for (i = 0; i < tree_num_paths; ++i)
+    tz_zone_close (zones[i]);
+  free (zones);
+  free (names);
+}
+
+static int
+bench_load (void)
+{
+  if (nftw (bench_tzdir, load_one, 16, FTW_PHYS) != 0)
+    {
+      perror (bench_tzdir);
+      return 1;
+    }
+  case_report (&cases[CASE_LOAD_COLD], "");
+  case_report (&cases[CASE_LOAD_WARM], "");
+  case_report (&cases[CASE_LOAD_SAME], "");
+  case_report (&cases[CASE_LOAD_WINDOW], "");
+
+  load_all (0);
+  load_all (1);
+  case_report (&cases[CASE_LOAD_OPEN_ALL], "");
+  case_report (&cases[CASE_LOAD_PRELOAD], "");
+  return 0;
+}
+
+/* Computing.  Each zone gets inputs for every code path it has: before
+   its first transition, within its transitions, after them under its
+   TZ string, and for zones from right/ anywhere in their range.  The
+   same inputs are then given to localtime_r with TZ set to the file.
+   Note that localtime_r also does the calendar breakdown, which
+   __tzfile_compute leaves to its caller; the localtime cases add
+   tz_breakdown to match, on the inputs within the transitions.  The
+   batch case converts BATCH_OPS at a time with tz_compute_batch and
+   tz_breakdown_batch, and has no glibc counterpart.  */
+
+#define BATCH_OPS 256
+
+static time_t compute_in[ZONE_SAMPLES * SAMPLE_OPS];
+static int32_t batch_gmtoff[BATCH_OPS];
+static struct tm batch_tm[BATCH_OPS];
+
+static time_t
+random_between (time_t lo, time_t hi)
+{
+  return lo + (time_t) (drand48 () * (double) (hi - lo));
+}
+
+static void
+compute_case (int which, const char *path)
+{
+  const size_t n = ZONE_SAMPLES * SAMPLE_OPS;
+  char *tz;
+  size_t s, k;
+
+  for (s = 0; s < n; s += SAMPLE_OPS)
+    {
+      long int leap_correct;
+      int leap_hit;
+      struct tm tm;
+      size_t a0 = allocs_now ();
+      double t0 = now_ns ();
+
+      for (k = s; k < s + SAMPLE_OPS; ++k)
+	{
+	  __tzfile_compute (compute_in[k], 1, &leap_correct, &leap_hit, &tm);
+	  if (which == CASE_LOCALTIME)
+	    tz_breakdown (compute_in[k], tm.tm_gmtoff, &tm);
+	  bench_sink += tm.tm_gmtoff + tm.tm_mday;
+	}
+      case_add (&cases[which], now_ns () - t0, SAMPLE_OPS,
+		allocs_now () - a0);
+    }
+
+  if (asprintf (&tz, ":%s", path) < 0)
+    return;
+  setenv ("TZ", tz, 1);
+  tzset ();
+  for (s = 0; s < n; s += SAMPLE_OPS)
+    {
+      struct tm tm;
+      size_t a0 = allocs_now ();
+      double t0 = now_ns ();
+
+      for (k = s; k < s + SAMPLE_OPS; ++k)
+	{
+	  localtime_r (&compute_in[k], &tm);
+	  bench_sink += tm.tm_gmtoff + tm.tm_mday;
+	}
+      case_add (&glibc_cases[which], now_ns () - t0, SAMPLE_OPS,
+		allocs_now () - a0);
+    }
+  free (tz);
+}
+
+static void
+localtime_batch_case (void)
+{
+  const size_t n = ZONE_SAMPLES * SAMPLE_OPS;
+  size_t s;
+
+  for (s = 0; s < n; s += BATCH_OPS)
+    {
+      size_t a0 = allocs_now ();
+      double t0 = now_ns ();
+
+      tz_compute_batch (tzfile_zone, compute_in + s, BATCH_OPS,
+			batch_gmtoff, NULL, NULL);
+      tz_breakdown_batch (compute_in + s, batch_gmtoff, BATCH_OPS,
+			  batch_tm);
+      bench_sink += batch_tm[0].tm_mday;
+      case_add (&cases[CASE_LOCALTIME_BATCH], now_ns () - t0, BATCH_OPS,
+		allocs_now () - a0);
+    }
+}
+
+static int
+compute_one (const char *path, const struct stat *sb, int flag,
+	     struct FTW *ftw)
+{
+  const size_t n = ZONE_SAMPLES * SAMPLE_OPS;
+  struct tz_zone *zone;
+  time_t first, last;
+  size_t k;
+
+  if (flag != FTW_F)
+    return 0;
+  __use_tzfile = 0;
+  __tzfile_read (bench_name (path), 0, NULL);
+  if (!__use_tzfile)
+    return 0;
+  zone = tzfile_zone;
+
+  if (zone->num_leaps > 0)
+    {
+      first = zone_leap_transition (zone, 0) - 20 * 365 * 86400L;
+      last = zone_leap_transition (zone, zone->num_leaps - 1)
+	     + 20 * 365 * 86400L;
+      for (k = 0; k < n; ++k)
+	compute_in[k] = random_between (first, last);
+      compute_case (CASE_LEAP, path);
+      return 0;
+    }
+  if (zone->num_transitions == 0)
+    return 0;
+
+  first = zone_transition (zone, 0);
+  last = zone_transition (zone, zone->num_transitions - 1);
+  for (k = 0; k < n; ++k)
+    compute_in[k] = random_between (first - 50 * 365 * 86400L, first - 1);
+  compute_case (CASE_BEFORE, path);
+
+  if (zone->num_transitions >= 2)
+    {
+      for (k = 0; k < n; ++k)
+	compute_in[k] = random_between (first, last - 1);
+      compute_case (zone->num_transitions < SHORT_HISTORY
+		    ? CASE_SEARCH_SHORT : CASE_SEARCH_LONG, path);
+      compute_case (CASE_LOCALTIME, path);
+      localtime_batch_case ();
+    }
+
+  if (zone->rules != NULL)
+    {
+      for (k = 0; k < n; ++k)
+	compute_in[k] = random_between (last, last + 100 * 365 * 86400L);
+      compute_case (CASE_RULES, path);
+    }
+  return 0;
+}
+
+static int
+bench_compute (void)
+{
+  int i;
+
+  srand48 (1);
+  if (nftw (bench_tzdir, compute_one, 16, FTW_PHYS) != 0)
+    {
+      perror (bench_tzdir);
+      return 1;
+    }
+  for (i = CASE_BEFORE; i <= CASE_LOCALTIME_BATCH; ++i)
+    {
+      glibc_cases[i].name = cases[i].name;
+      case_report (&cases[i], "");
+      case_report (&glibc_cases[i], "glibc/");
+    }
+  return bench_sink == 0;
+}
+
+/* Formatting.  Each zone stamps a run of log-like times, a few hundred
+   a second, starting at random in 2000 through 2029: one at a time,
+   in batches of BATCH_OPS, and with localtime_r and strftime, which
+   is what a C caller does without a formatter.  */
+
+static long int format_nsec[ZONE_SAMPLES * SAMPLE_OPS];
+static char format_buf[BATCH_OPS * TZ_FORMAT_MAX];
+
+static int
+format_zone (const char *path, const struct stat *sb, int flag,
+	     struct FTW *ftw)
+{
+  const size_t n = ZONE_SAMPLES * SAMPLE_OPS;
+  struct tz_zone *zone;
+  struct tz_format *fmt;
+  time_t t;
+  char *tz;
+  size_t s, k;
+
+  if (flag != FTW_F)
+    return 0;
+  zone = tz_zone_open (bench_name (path));
+  if (zone == NULL)
+    return 0;
+  fmt = tz_format_new (zone, TZ_FORMAT_RFC3339, TZ_FORMAT_MSEC);
+  tz_zone_close (zone);
+
+  t = random_between (year_start (2000), year_start (2030));
+  for (k = 0; k < n; ++k)
+    {
+      compute_in[k] = t;
+      format_nsec[k] = lrand48 () % 1000000000;
+      t += lrand48 () % 100 == 0;
+    }
+
+  for (s = 0; s < n; s += SAMPLE_OPS)
+    {
+      size_t a0 = allocs_now ();
+      double t0 = now_ns ();
+
+      for (k = s; k < s + SAMPLE_OPS; ++k)
+	bench_sink += tz_format (fmt, compute_in[k], format_nsec[k],
+				 format_buf, TZ_FORMAT_MAX);
+      case_add (&cases[CASE_FORMAT], now_ns () - t0, SAMPLE_OPS,
+		allocs_now () - a0);
+    }
+  for (s = 0; s < n; s += BATCH_OPS)
+    {
+      size_t a0 = allocs_now ();
+      double t0 = now_ns ();
+
+      tz_format_batch (fmt, compute_in + s, format_nsec + s, BATCH_OPS,
+		       format_buf, sizeof format_buf, NULL);
+      bench_sink += format_buf[0];
+      case_add (&cases[CASE_FORMAT_BATCH], now_ns () - t0, BATCH_OPS,
+		allocs_now () - a0);
+    }
+  tz_format_free (fmt);
+
+  if (asprintf (&tz, ":%s", path) < 0)
+    return 0;
+  setenv ("TZ", tz, 1);
+  tzset ();
+  for (s = 0; s < n; s += SAMPLE_OPS)
+    {
+      size_t a0 = allocs_now ();
+      double t0 = now_ns ();
+
+      for (k = s; k < s + SAMPLE_OPS; ++k)
+	{
+	  struct tm tm;
+	  long int off;
+	  size_t len;
+
+	  localtime_r (&compute_in[k], &tm);
+	  off = labs (tm.tm_gmtoff);
+	  len = strftime (format_buf, TZ_FORMAT_MAX, "%Y-%m-%dT%H:%M:%S", &tm);
+	  len += snprintf (format_buf + len, TZ_FORMAT_MAX - len,
+			   ".%03ld%c%02ld:%02ld", format_nsec[k] / 1000000,
+			   tm.tm_gmtoff < 0 ? '-' : '+', off / 3600,
+			   off / 60 % 60);
+	  bench_sink += len;
+	}
+      case_add (&glibc_cases[CASE_FORMAT], now_ns () - t0, SAMPLE_OPS,
+		allocs_now () - a0);
+    }
+  free (tz);
+  return 0;
+}
+
+static int
+bench_format (void)
+{
+  srand48 (1);
+  if (nftw (bench_tzdir, format_zone, 16, FTW_PHYS) != 0)
+    {
+      perror (bench_tzdir);
+      return 1;
+    }
+  glibc_cases[CASE_FORMAT].name = cases[CASE_FORMAT].name;
+  case_report (&cases[CASE_FORMAT], "");
+  case_report (&glibc_cases[CASE_FORMAT], "glibc/");
+  case_report (&cases[CASE_FORMAT_BATCH], "");
+  return bench_sink == 0;
+}
+
+/* Scaling.  Threads look up the same zone at once, each the same
+   number of times, for 1, 2, 4 ... threads up to the number of CPUs:
+   with tz_zone_lookup, which writes nothing shared; with
+   __tzfile_compute, which writes __tzname and the other globals every
+   time; and with localtime_r.  ns/op is the time per lookup in each
+   thread, which stays flat for as long as lookups scale linearly.  */
+
+#define SCALE_ZONE "Europe/Berlin"
+#define SCALE_INPUTS 4096	/* A power of two.  */
+
+enum
+  {
+    SCALE_LOOKUP,
+    SCALE_COMPUTE,
+    SCALE_GLIBC,
+    SCALE_CASES
+  };
+
+static const struct
+{
+  const char *name;
+  size_t ops;			/* Lookups in each thread.  */
+} scale_cases[SCALE_CASES] =
+  {
+    { "scale/lookup", 1 << 21 },
+    { "scale/compute", 1 << 20 },
+    { "glibc/scale/localtime", 1 << 16 }
+  };
+
+struct scale_thread
+{
+  pthread_t thread;
+  int which;
+  size_t start;
+  double ns;
+};
+
+static struct tz_zone *scale_zone;
+static time_t scale_in[SCALE_INPUTS];
+static pthread_barrier_t scale_barrier;
+
+static void *
+scale_run (void *arg)
+{
+  struct scale_thread *t = arg;
+  const size_t ops = scale_cases[t->which].ops;
+  size_t k, sink = 0;
+  double t0;
+
+  pthread_barrier_wait (&scale_barrier);
+  t0 = now_ns ();
+  switch (t->which)
+    {
+    case SCALE_LOOKUP:
+      for (k = 0; k < ops; ++k)
+	{
+	  struct tz_lookup result;
+
+	  tz_zone_lookup (scale_zone,
+			  scale_in[(t->start + k) & (SCALE_INPUTS - 1)],
+			  &result);
+	  sink += result.gmtoff;
+	}
+      break;
+    case SCALE_COMPUTE:
+      for (k = 0; k < ops; ++k)
+	{
+	  long int leap_correct;
+	  int leap_hit;
+	  struct tm tm;
+
+	  __tzfile_compute (scale_in[(t->start + k) & (SCALE_INPUTS - 1)],
+			    1, &leap_correct, &leap_hit, &tm);
+	  sink += tm.tm_gmtoff;
+	}
+      break;
+    case SCALE_GLIBC:
+      for (k = 0; k < ops; ++k)
+	{
+	  struct tm tm;
+
+	  localtime_r (&scale_in[(t->start + k) & (SCALE_INPUTS - 1)], &tm);
+	  sink += tm.tm_gmtoff;
+	}
+      break;
+    }
+  t->ns = now_ns () - t0;
+  __atomic_add_fetch (&bench_sink, sink, __ATOMIC_RELAXED);
+  return NULL;
+}
+
+/* Run case WHICH in NTHREADS threads, and return the time it took all
+   of them in ns.  */
+static double
+scale_case (int which, int nthreads)
+{
+  struct scale_thread *threads;
+  double ns = 0;
+  int i;
+
+  threads = calloc (nthreads, sizeof *threads);
+  if (threads == NULL)
+    {
+      perror ("tzbench");
+      exit (1);
+    }
+  pthread_barrier_init (&scale_barrier, NULL, nthreads);
+  for (i = 0; i < nthreads; ++i)
+    {
+      threads[i].which = which;
+      threads[i].start = i * (SCALE_INPUTS / 7);
+      if (pthread_create (&threads[i].thread, NULL, scale_run,
+			  &threads[i]) != 0)
+	{
+	  perror ("tzbench");
+	  exit (1);
+	}
+    }
+  for (i = 0; i < nthreads; ++i)
+    {
+      pthread_join (threads[i].thread, NULL);
+      ns = threads[i].ns > ns ? threads[i].ns : ns;
+    }
+  pthread_barrier_destroy (&scale_barrier);
+  free (threads);
+  return ns;
+}
+
+static int
+bench_scale (void)
+{
+  double base[SCALE_CASES];
+  long int cpus = sysconf (_SC_NPROCESSORS_ONLN);
+  char *tz;
+  int which, n;
+  size_t k;
+
+  scale_zone = tz_zone_open (SCALE_ZONE);
+  __tzfile_read (SCALE_ZONE, 0, NULL);
+  if (scale_zone == NULL || !__use_tzfile
+      || asprintf (&tz, ":%s/%s", bench_tzdir, SCALE_ZONE) < 0)
+    {
+      perror (SCALE_ZONE);
+      return 1;
+    }
+  setenv ("TZ", tz, 1);
+  tzset ();
+  free (tz);
+
+  /* 1900 through 2099, so that the searches and the TZ rules both
+     count.  */
+  srand48 (1);
+  for (k = 0; k < SCALE_INPUTS; ++k)
+    scale_in[k] = random_between (year_start (1900), year_start (2100));
+
+  if (!bench_json)
+    printf ("%-22s %7s %10s %10s %8s\n", "case", "threads", "ns/op",
+	    "Mops/s", "speedup");
+  for (n = 1; ; n = n * 2 < cpus ? n * 2 : cpus)
+    {
+      for (which = 0; which < SCALE_CASES; ++which)
+	{
+	  double ns = scale_case (which, n);
+	  double ns_per_op = ns / scale_cases[which].ops;
+	  double mops = 1e3 * n / ns_per_op;
+
+	  if (n == 1)
+	    base[which] = mops;
+	  if (bench_json)
+	    printf ("{\"case\":\"%s\",\"threads\":%d,\"ops\":%zu,"
+		    "\"ns_per_op\":%.2f,\"mops\":%.2f,\"speedup\":%.2f}\n",
+		    scale_cases[which].name, n, n * scale_cases[which].ops,
+		    ns_per_op, mops, mops / base[which]);
+	  else
+	    printf ("%-22s %7d %10.1f %10.1f %8.2f\n",
+		    scale_cases[which].name, n, ns_per_op, mops,
+		    mops / base[which]);
+	}
+      if (n >= cpus)
+	break;
+    }
+  tz_zone_close (scale_zone);
+  return bench_sink == 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+  const char *mode;
+  int result;
+
+  if (argc > 1 && strcmp (argv[1], "-j") == 0)
+    {
+      bench_json = 1;
+      --argc;
+      ++argv;
+    }
+  if (argc < 2)
+    {
+      fprintf (stderr,
+	       "usage: %s [-j] layout|memory|load|compute|format|scale|all "
+	       "[TZDIR]\n", argv[0]);
+      return 2;
+    }
+  mode = argv[1];
+  bench_tzdir = argc > 2 ? argv[2] : tzfile_dir ();
+  /* __tzfile_read looks relative names up here.  */
+  setenv ("TZDIR", bench_tzdir, 1);
+
+  if (strcmp (mode, "layout") == 0)
+    return bench_layout ();
+  if (strcmp (mode, "memory") == 0)
+    return bench_memory ();
+  if (strcmp (mode, "load") == 0)
+    {
+      report_header ();
+      return bench_load ();
+    }
+  if (strcmp (mode, "compute") == 0)
+    {
+      report_header ();
+      return bench_compute ();
+    }
+  if (strcmp (mode, "format") == 0)
+    {
+      report_header ();
+      return bench_format ();
+    }
+  if (strcmp (mode, "scale") == 0)
+    return bench_scale ();
+  if (strcmp (mode, "all") == 0)
+    {
+      report_header ();
+      result = bench_load ();
+      return result != 0 ? result : bench_compute ();
+    }
+
+  fprintf (stderr, "%s: unknown benchmark `%s'\n", argv[0], mode);
+  return 2;
+}
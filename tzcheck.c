@@ -0,0 +1,917 @@
+/* Check the tzfile reader against zic and glibc.
+
+   zic compiles each source file SOURCE with "-b slim" into a scratch
+   directory, and then for every Zone and Link named in it:
+
+     compile	tz_zone_compile on SOURCE against the file zic wrote:
+		its transitions, TZ string and lookups; if zic rejects
+		SOURCE, tz_zone_compile must fail with EINVAL
+     lookup	tz_zone_lookup on that file against glibc localtime_r
+     local	tz_local_to_utc with each gap and fold policy, against
+		the instants localtime_r gives the same wall time
+     image	tz_zone_image, whole and for windows of years, read back
+     index	tz_zone_set_index, with the default and smallest buckets
+     compact	tz_zone_compact
+     db		tz_db_zone, with the files packed by tzdb_build
+     window	tz_zone_open_window, for windows of years
+     batch	tz_compute_batch
+     breakdown	tz_breakdown and tz_breakdown_batch against gmtime_r
+     format	tz_format and tz_format_batch in each style, against
+		gmtime_r and strftime
+     tai	tz_utc_to_tai and back with tz_tai_to_utc
+
+   The alternatives are compared with tz_zone_lookup on the file zic
+   wrote.  Each is checked at both sides of every transition and at
+   instants from 1811 to 2191, which takes lookups well past the
+   transitions into the zone's TZ string.  If the zone directory has
+   right/UTC, its leap seconds are checked too: TAI from tz_utc_to_tai,
+   less 10 seconds, must give under glibc what gmtime_r gives for the
+   UTC time.  It is built with the reader, and tzdb_build next to it:
+
+	cc -O2 -o tzcheck tzcheck.c tzzone.c -lpthread
+	cc -O2 -o tzdb_build tzdb_build.c tzzone.c -lpthread
+
+   Usage: tzcheck [SOURCE]...
+
+   The sources default to tzdata.zi in the zone directory and the
+   israel_summer*.zic files next to tzcheck.  zic must be on the PATH;
+   tzdb_build is run from where tzcheck was.  Mismatches are printed,
+   and the exit status is 1 if there were any, 2 if the check could
+   not be run.  */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "tzzone-internal.h"
+
+/* The instants checked besides the transitions.  */
+#define SWEEP_FROM	(-5000000000LL)
+#define SWEEP_TO	7000000000LL
+#define SWEEP_STEP	(13 * SECSPERDAY + 3607)
+
+/* Mismatches printed before the rest are only counted.  */
+#define MAX_REPORTS	50
+
+/* The sources checked by default besides tzdata.zi, in the directory
+   of tzcheck.  Zic rejects the last two: each has two rules for the
+   same instant.  */
+static const char *const check_files[] =
+{
+  "israel_summer.zic",
+  "israel_summer2.zic",
+  "israel_summer3.zic",
+};
+
+#define CHECK_DIR	"/tmp/tzcheck.XXXXXX"
+#define CHECK_DB	"/tzcheck.db"
+
+static char check_dir[sizeof CHECK_DIR];
+static char check_db[sizeof CHECK_DIR + sizeof CHECK_DB];
+static char *check_tzdb_build;
+static char *check_tzdir;
+
+static size_t check_zones, check_checks, check_gaps, check_folds;
+static size_t check_rejected, check_bad;
+
+static void
+report (const char *name, const char *what, time_t t, const char *fmt, ...)
+{
+  va_list ap;
+
+  if (check_bad++ >= MAX_REPORTS)
+    return;
+  printf ("%s: %s at %lld: ", name, what, (long long int) t);
+  va_start (ap, fmt);
+  vprintf (fmt, ap);
+  va_end (ap);
+  putchar ('\n');
+}
+
+/* Return the contents of PATH, or NULL.  */
+static char *
+read_source (const char *path)
+{
+  char *source = NULL;
+  size_t size = 0;
+  FILE *f;
+
+  f = fopen (path, "r");
+  if (f == NULL)
+    return NULL;
+  if (getdelim (&source, &size, '\0', f) < 0)
+    {
+      free (source);
+      source = NULL;
+    }
+  fclose (f);
+  return source;
+}
+
+/* Run ARGV[0], searched for as execvp does, with its standard output
+   discarded.  Return its exit status, or -1 if it could not be run.  */
+static int
+run (char *const argv[])
+{
+  pid_t pid;
+  int status;
+
+  pid = fork ();
+  if (pid < 0)
+    return -1;
+  if (pid == 0)
+    {
+      if (freopen ("/dev/null", "w", stdout) != NULL)
+	execvp (argv[0], argv);
+      perror (argv[0]);
+      _exit (127);
+    }
+  if (waitpid (pid, &status, 0) < 0 || !WIFEXITED (status)
+      || WEXITSTATUS (status) == 127)
+    return -1;
+  return WEXITSTATUS (status);
+}
+
+static int
+remove_one (const char *path, const struct stat *sb, int flag,
+	    struct FTW *ftw)
+{
+  return remove (path);
+}
+
+/* The offset glibc gives T in the zone TZ is set to, or LONG_MIN.  */
+static long int
+glibc_offset (time_t t)
+{
+  struct tm tm;
+
+  return localtime_r (&t, &tm) != NULL ? tm.tm_gmtoff : LONG_MIN;
+}
+
+static int
+same_lookup (const struct tz_lookup *a, const struct tz_lookup *b)
+{
+  return (a->gmtoff == b->gmtoff && !a->isdst == !b->isdst
+	  && strcmp (a->abbr, b->abbr) == 0);
+}
+
+/* Compare the fields gmtime_r fills in, but for tm_gmtoff.  */
+static int
+same_tm (const struct tm *a, const struct tm *b)
+{
+  return (a->tm_sec == b->tm_sec && a->tm_min == b->tm_min
+	  && a->tm_hour == b->tm_hour && a->tm_mday == b->tm_mday
+	  && a->tm_mon == b->tm_mon && a->tm_year == b->tm_year
+	  && a->tm_wday == b->tm_wday && a->tm_yday == b->tm_yday);
+}
+
+/* Compare lookups at T in ZONE, the file zic wrote for NAME, with
+   COMPILED and with glibc.  */
+static void
+check_lookup (const char *name, const struct tz_zone *zone,
+	      const struct tz_zone *compiled, time_t t)
+{
+  struct tz_lookup want, got;
+  struct tm tm;
+
+  ++check_checks;
+  if (tz_zone_lookup (zone, t, &want) != 0)
+    {
+      report (name, "lookup", t, "%s", strerror (errno));
+      return;
+    }
+
+  if (compiled != NULL)
+    {
+      if (tz_zone_lookup (compiled, t, &got) != 0)
+	report (name, "compile", t, "%s", strerror (errno));
+      else if (!same_lookup (&got, &want))
+	report (name, "compile", t, "%ld %d %s, zic %ld %d %s",
+		got.gmtoff, got.isdst, got.abbr,
+		want.gmtoff, want.isdst, want.abbr);
+    }
+
+  if (localtime_r (&t, &tm) != NULL
+      && (tm.tm_gmtoff != want.gmtoff || !tm.tm_isdst != !want.isdst
+	  || strcmp (tm.tm_zone, want.abbr) != 0))
+    report (name, "lookup", t, "%ld %d %s, glibc %ld %d %s",
+	    want.gmtoff, want.isdst, want.abbr,
+	    tm.tm_gmtoff, tm.tm_isdst, tm.tm_zone);
+}
+
+/* Convert the wall time LOCAL in ZONE to UTC under each policy, and
+   check the results against the instants whose glibc offsets, among
+   the NUM_OFFSETS in OFFSETS, make them LOCAL.  */
+static void
+check_local (const char *name, struct tz_zone *zone, time_t local,
+	     const long int *offsets, size_t num_offsets)
+{
+  time_t earliest = 0, latest = 0, earlier, later, rejected;
+  int found = 0, e, l, r;
+  size_t i;
+
+  for (i = 0; i < num_offsets; ++i)
+    {
+      time_t u = local - offsets[i];
+
+      if (glibc_offset (u) != offsets[i])
+	continue;
+      if (found == 0 || u < earliest)
+	earliest = u;
+      if (found == 0 || u > latest)
+	latest = u;
+      found = 1;
+    }
+
+  e = tz_local_to_utc (zone, local, TZ_LOCAL_EARLIER, TZ_LOCAL_EARLIER,
+		       &earlier);
+  l = tz_local_to_utc (zone, local, TZ_LOCAL_LATER, TZ_LOCAL_LATER, &later);
+  r = tz_local_to_utc (zone, local, TZ_LOCAL_REJECT, TZ_LOCAL_REJECT,
+		       &rejected);
+  ++check_checks;
+
+  if (found && earliest == latest)
+    {
+      if (e != TZ_LOCAL_UNIQUE || l != TZ_LOCAL_UNIQUE
+	  || r != TZ_LOCAL_UNIQUE || earlier != earliest
+	  || later != earliest || rejected != earliest)
+	report (name, "local", local, "%d %d %d, glibc has only %lld",
+		e, l, r, (long long int) earliest);
+    }
+  else if (found)
+    {
+      ++check_folds;
+      if (e != TZ_LOCAL_FOLD || l != TZ_LOCAL_FOLD || r != -1
+	  || earlier != earliest || later != latest)
+	report (name, "local", local, "%d %d %d, glibc has %lld and %lld",
+		e, l, r, (long long int) earliest, (long long int) latest);
+    }
+  else
+    {
+      /* In a gap, the candidates read LOCAL with the offsets after
+	 and before the change, so each lands as far on the other side
+	 of it as the gap is wide.  */
+      ++check_gaps;
+      if (e != TZ_LOCAL_GAP || l != TZ_LOCAL_GAP || r != -1
+	  || later <= earlier
+	  || earlier + glibc_offset (earlier) != local - (later - earlier)
+	  || later + glibc_offset (later) != local + (later - earlier))
+	report (name, "local", local, "%d %d %d, in a gap for glibc",
+		e, l, r);
+    }
+}
+
+/* Compare lookups in COPY, which WHAT made of ZONE, with those in ZONE
+   at the instants in T[0] through T[N - 1], or only at those in
+   [FROM, TO) if FROM is before TO.  Then close COPY.  */
+static void
+check_copy (const char *name, const char *what, const struct tz_zone *zone,
+	    struct tz_zone *copy, time_t from, time_t to, const time_t *t,
+	    size_t n)
+{
+  struct tz_lookup want, got;
+  size_t i;
+
+  if (copy == NULL)
+    {
+      report (name, what, from, "cannot be made: %s", strerror (errno));
+      return;
+    }
+  for (i = 0; i < n; ++i)
+    {
+      if (from < to && (t[i] < from || t[i] >= to))
+	continue;
+      /* Failures of ZONE itself are check_lookup's to report.  */
+      if (tz_zone_lookup (zone, t[i], &want) != 0)
+	continue;
+      ++check_checks;
+      if (tz_zone_lookup (copy, t[i], &got) != 0)
+	report (name, what, t[i], "%s", strerror (errno));
+      else if (!same_lookup (&got, &want))
+	report (name, what, t[i], "%ld %d %s, want %ld %d %s",
+		got.gmtoff, got.isdst, got.abbr,
+		want.gmtoff, want.isdst, want.abbr);
+    }
+  tz_zone_close (copy);
+}
+
+/* Write ZONE as an image for [FROM, TO) with FLAGS, read it back and
+   compare lookups at the instants in T[0] through T[N - 1] inside the
+   window.  */
+static void
+check_image (const char *name, struct tz_zone *zone, time_t from,
+	     time_t to, int flags, const time_t *t, size_t n)
+{
+  struct tz_zone *copy;
+  void *image;
+  size_t size;
+
+  image = tz_zone_image (zone, from, to, flags, &size);
+  copy = image != NULL ? tzfile_parse (image, size, 0, NULL, 1, NULL) : NULL;
+  if (copy == NULL)
+    free (image);
+  else
+    copy->map_heap = 1;
+  check_copy (name, "image", zone, copy, from, to, t, n);
+}
+
+/* Compare the other ways there are to look up times in ZONE, the file
+   zic wrote at PATH for NAME, with tz_zone_lookup on it.  DB is the
+   database packed from the files zic wrote.  */
+static void
+check_paths (const char *name, const char *path, struct tz_zone *zone,
+	     struct tz_db *db, const time_t *t, size_t n)
+{
+  struct tz_zone *copy;
+  int year;
+
+  /* The index is set on a zone of its own, so that the other checks
+     still do without.  */
+  copy = tzfile_load (path, 0, NULL, 1, NULL);
+  if (copy != NULL && tz_zone_set_index (copy, TZ_INDEX_SHIFT_DEFAULT) == 0)
+    {
+      check_copy (name, "index", zone, copy, 0, 0, t, n);
+      copy = tzfile_load (path, 0, NULL, 1, NULL);
+      if (copy != NULL)
+	tz_zone_set_index (copy, TZ_INDEX_SHIFT_MIN);
+    }
+  check_copy (name, "index", zone, copy, 0, 0, t, n);
+
+  check_copy (name, "compact", zone, tz_zone_compact (zone), 0, 0, t, n);
+  check_copy (name, "db", zone, tz_db_zone (db, name), 0, 0, t, n);
+  for (year = 1850; year < 2150; year += 25)
+    check_copy (name, "window", zone,
+		tz_zone_open_window (name, year_start (year),
+				     year_start (year + 10)),
+		year_start (year), year_start (year + 10), t, n);
+}
+
+/* Check tz_compute_batch on ZONE against tz_zone_lookup, and then
+   tz_breakdown and tz_breakdown_batch against gmtime_r, at the instants
+   in T[0] through T[N - 1].  */
+static int
+check_batch (const char *name, struct tz_zone *zone, const time_t *t,
+	     size_t n)
+{
+  struct tz_lookup want;
+  struct tm *batch, tm, got;
+  int32_t *gmtoff;
+  uint8_t *isdst, *type;
+  time_t local;
+  size_t i;
+  int result = -1;
+
+  gmtoff = malloc (n * sizeof *gmtoff);
+  isdst = malloc (n);
+  type = malloc (n);
+  batch = malloc (n * sizeof *batch);
+  if (gmtoff == NULL || isdst == NULL || type == NULL || batch == NULL)
+    goto out;
+  result = 0;
+
+  if (tz_compute_batch (zone, t, n, gmtoff, isdst, type) != 0)
+    {
+      report (name, "batch", 0, "%s", strerror (errno));
+      goto out;
+    }
+  if (tz_breakdown_batch (t, gmtoff, n, batch) != 0)
+    report (name, "breakdown", 0, "batch: %s", strerror (errno));
+
+  for (i = 0; i < n; ++i)
+    {
+      if (tz_zone_lookup (zone, t[i], &want) != 0)
+	continue;
+      ++check_checks;
+      if (gmtoff[i] != want.gmtoff || !isdst[i] != !want.isdst
+	  || (type[i] != TZ_TYPE_RULE
+	      && (type[i] >= zone->num_types
+		  || zone_type_offset (zone, type[i]) != want.gmtoff)))
+	report (name, "batch", t[i], "%ld %d type %d, want %ld %d",
+		(long int) gmtoff[i], isdst[i], type[i],
+		want.gmtoff, want.isdst);
+
+      local = t[i] + want.gmtoff;
+      if (gmtime_r (&local, &tm) == NULL)
+	continue;
+      if (tz_breakdown (t[i], want.gmtoff, &got) != 0
+	  || !same_tm (&got, &tm) || got.tm_gmtoff != want.gmtoff)
+	report (name, "breakdown", t[i], "not as gmtime_r at %+ld",
+		want.gmtoff);
+      if (gmtoff[i] == want.gmtoff && !same_tm (&batch[i], &tm))
+	report (name, "breakdown", t[i], "batch: not as gmtime_r at %+ld",
+		want.gmtoff);
+    }
+
+ out:
+  free (gmtoff);
+  free (isdst);
+  free (type);
+  free (batch);
+  return result;
+}
+
+/* Write to BUF, of SIZE bytes, the stamp a formatter in STYLE with
+   FLAGS should write for T and NSEC, given the lookup WANT at T: the
+   date and time with gmtime_r and strftime, at the offset rounded to
+   the minute unless TZ_FORMAT_OFFSET_SEC keeps its seconds.  Returns
+   -1 if gmtime_r fails.  */
+static int
+format_want (int style, int flags, time_t t, long int nsec,
+	     const struct tz_lookup *want, char *buf, size_t size)
+{
+  const char *colon = style == TZ_FORMAT_RFC3339 ? ":" : "";
+  long int off = want->gmtoff, abs_off = off < 0 ? -off : off;
+  char frac[24] = "";
+  struct tm tm;
+  time_t local;
+  size_t len;
+
+  if (style != TZ_FORMAT_CTIME && !(flags & TZ_FORMAT_OFFSET_SEC))
+    {
+      abs_off = (abs_off + 30) / 60 * 60;
+      off = off < 0 ? -abs_off : abs_off;
+    }
+  local = t + off;
+  if (gmtime_r (&local, &tm) == NULL)
+    return -1;
+  if (flags & TZ_FORMAT_MSEC)
+    sprintf (frac, ".%03ld", nsec / 1000000);
+  else if (flags & TZ_FORMAT_USEC)
+    sprintf (frac, ".%06ld", nsec / 1000);
+
+  if (style == TZ_FORMAT_CTIME)
+    {
+      len = strftime (buf, size, "%a %b %e %H:%M:%S", &tm);
+      len += snprintf (buf + len, size - len, "%s%s%s ", frac,
+		       flags & TZ_FORMAT_ABBR ? " " : "",
+		       flags & TZ_FORMAT_ABBR ? want->abbr : "");
+      strftime (buf + len, size - len, "%Y", &tm);
+      return 0;
+    }
+  len = strftime (buf, size, "%Y-%m-%dT%H:%M:%S", &tm);
+  len += snprintf (buf + len, size - len, "%s%c%02ld%s%02ld", frac,
+		   off < 0 ? '-' : '+', abs_off / 3600, colon,
+		   abs_off / 60 % 60);
+  if (abs_off % 60 != 0)
+    len += snprintf (buf + len, size - len, "%s%02ld", colon, abs_off % 60);
+  if (flags & TZ_FORMAT_ABBR)
+    snprintf (buf + len, size - len, " %s", want->abbr);
+  return 0;
+}
+
+/* Check the stamps of formatters for ZONE in each style, written one
+   at a time with tz_format and all at once with tz_format_batch, at
+   the instants in T[0] through T[N - 1].  */
+static int
+check_format (const char *name, struct tz_zone *zone, const time_t *t,
+	      size_t n)
+{
+  static const int formats[][2] =
+  {
+    { TZ_FORMAT_ISO8601, 0 },
+    { TZ_FORMAT_RFC3339, TZ_FORMAT_ABBR },
+    { TZ_FORMAT_ISO8601, TZ_FORMAT_USEC | TZ_FORMAT_OFFSET_SEC },
+    { TZ_FORMAT_CTIME, TZ_FORMAT_MSEC | TZ_FORMAT_ABBR },
+  };
+  struct tz_format *one, *batch;
+  struct tz_lookup want;
+  char *buf, stamp[TZ_FORMAT_MAX], expect[TZ_FORMAT_MAX];
+  long int *nsec;
+  size_t *ends, i, k;
+  int result = -1;
+
+  buf = malloc (n * TZ_FORMAT_MAX);
+  nsec = malloc (n * sizeof *nsec);
+  ends = malloc (n * sizeof *ends);
+  if (buf == NULL || nsec == NULL || ends == NULL)
+    goto out;
+  for (i = 0; i < n; ++i)
+    nsec[i] = (i * 123456789L) % 1000000000;
+
+  for (k = 0; k < sizeof formats / sizeof formats[0]; ++k)
+    {
+      one = tz_format_new (zone, formats[k][0], formats[k][1]);
+      batch = tz_format_new (zone, formats[k][0], formats[k][1]);
+      if (one == NULL || batch == NULL)
+	{
+	  tz_format_free (one);
+	  tz_format_free (batch);
+	  goto out;
+	}
+      if (tz_format_batch (batch, t, nsec, n, buf, n * TZ_FORMAT_MAX,
+			   ends) != 0)
+	report (name, "format", 0, "batch: %s", strerror (errno));
+      else
+	for (i = 0; i < n; ++i)
+	  {
+	    if (tz_zone_lookup (zone, t[i], &want) != 0
+		|| format_want (formats[k][0], formats[k][1], t[i], nsec[i],
+				&want, expect, sizeof expect) != 0)
+	      continue;
+	    ++check_checks;
+	    if (tz_format (one, t[i], nsec[i], stamp, sizeof stamp) < 0)
+	      report (name, "format", t[i], "%s", strerror (errno));
+	    else if (strcmp (stamp, expect) != 0)
+	      report (name, "format", t[i], "\"%s\", want \"%s\"",
+		      stamp, expect);
+	    if (strcmp (buf + (i > 0 ? ends[i - 1] : 0), expect) != 0)
+	      report (name, "format", t[i], "batch: \"%s\", want \"%s\"",
+		      buf + (i > 0 ? ends[i - 1] : 0), expect);
+	  }
+      tz_format_free (one);
+      tz_format_free (batch);
+    }
+  result = 0;
+
+ out:
+  free (buf);
+  free (nsec);
+  free (ends);
+  return result;
+}
+
+/* Check that tz_tai_to_utc undoes tz_utc_to_tai with the leap seconds
+   of ZONE, at the instants in T[0] through T[N - 1].  */
+static int
+check_tai (const char *name, struct tz_zone *zone, const time_t *t,
+	   size_t n)
+{
+  time_t *tai;
+  size_t i;
+
+  tai = malloc (n * sizeof *tai);
+  if (tai == NULL)
+    return -1;
+  if (tz_utc_to_tai (zone, t, n, tai) != 0
+      || tz_tai_to_utc (zone, tai, n, tai) != 0)
+    report (name, "tai", 0, "%s", strerror (errno));
+  else
+    for (i = 0; i < n; ++i)
+      {
+	++check_checks;
+	if (tai[i] != t[i])
+	  report (name, "tai", t[i], "back as %lld", (long long int) tai[i]);
+      }
+  free (tai);
+  return 0;
+}
+
+/* Check TAI conversions with the leap seconds of right/UTC in the zone
+   directory against glibc.  Its times count TAI less 10 seconds, so
+   what localtime_r gives for those is what gmtime_r gives for UTC
+   outside that zone, as glibc applies leap seconds in gmtime_r too;
+   but for 60 seconds in a leap second, which tz_tai_to_utc gives as
+   the second before.  */
+static int
+check_leaps (void)
+{
+  struct tz_zone *zone;
+  struct tm *got = NULL, *want = NULL;
+  time_t *utc = NULL, *right = NULL, t, tai;
+  char *path, *tz = NULL;
+  size_t n, k;
+  int d, result = -1;
+
+  if (asprintf (&path, "%s/right/UTC", check_tzdir) < 0)
+    return -1;
+  zone = tzfile_load (path, 0, NULL, 1, NULL);
+  if (zone == NULL)
+    {
+      /* No leap seconds to check with.  */
+      free (path);
+      return 0;
+    }
+  n = (SWEEP_TO - SWEEP_FROM) / SWEEP_STEP + 1 + 5 * zone->num_leaps;
+  utc = malloc (n * sizeof *utc);
+  right = malloc (n * sizeof *right);
+  got = malloc (n * sizeof *got);
+  want = malloc (n * sizeof *want);
+  if (utc == NULL || right == NULL || got == NULL || want == NULL
+      || asprintf (&tz, ":%s", path) < 0)
+    goto out;
+
+  /* UTC to TAI across the sweep, and TAI to UTC around each leap.  */
+  n = 0;
+  for (t = SWEEP_FROM; t < SWEEP_TO; t += SWEEP_STEP, ++n)
+    {
+      utc[n] = t;
+      tz_utc_to_tai (zone, &t, 1, &tai);
+      right[n] = tai - 10;
+    }
+  for (k = 0; k < zone->num_leaps; ++k)
+    for (d = -2; d <= 2; ++d, ++n)
+      {
+	right[n] = zone_leap_transition (zone, k) + d;
+	tai = right[n] + 10;
+	tz_tai_to_utc (zone, &tai, 1, &utc[n]);
+      }
+
+  setenv ("TZ", "UTC0", 1);
+  tzset ();
+  for (k = 0; k < n; ++k)
+    gmtime_r (&utc[k], &want[k]);
+  setenv ("TZ", tz, 1);
+  tzset ();
+  for (k = 0; k < n; ++k)
+    {
+      ++check_checks;
+      if (localtime_r (&right[k], &got[k]) == NULL)
+	continue;
+      if (got[k].tm_sec == 60)
+	got[k].tm_sec = 59;
+      if (!same_tm (&got[k], &want[k]))
+	report ("right/UTC", "tai", utc[k], "%lld, not as glibc",
+		(long long int) right[k] + 10);
+    }
+  result = 0;
+
+ out:
+  free (utc);
+  free (right);
+  free (got);
+  free (want);
+  free (tz);
+  free (path);
+  tz_zone_close (zone);
+  return result;
+}
+
+/* Compare the transitions and TZ string of COMPILED with those of
+   ZONE, the file zic wrote for NAME.  */
+static void
+check_compiled (const char *name, const struct tz_zone *zone,
+		const struct tz_zone *compiled)
+{
+  size_t i;
+
+  ++check_checks;
+  if (compiled->num_transitions != zone->num_transitions)
+    report (name, "compile", 0, "%zu transitions, zic %zu",
+	    compiled->num_transitions, zone->num_transitions);
+  else
+    for (i = 0; i < zone->num_transitions; ++i)
+      if (zone_transition (compiled, i) != zone_transition (zone, i))
+	{
+	  report (name, "compile", zone_transition (zone, i),
+		  "transition %zu at %lld", i,
+		  (long long int) zone_transition (compiled, i));
+	  break;
+	}
+  if ((compiled->tzspec == NULL) != (zone->tzspec == NULL)
+      || (zone->tzspec != NULL
+	  && strcmp (compiled->tzspec, zone->tzspec) != 0))
+    report (name, "compile", 0, "TZ string \"%s\", zic \"%s\"",
+	    compiled->tzspec != NULL ? compiled->tzspec : "",
+	    zone->tzspec != NULL ? zone->tzspec : "");
+}
+
+static int
+check_zone (const char *source, struct tz_db *db, const char *name)
+{
+  struct tz_zone *zone, *compiled;
+  struct tz_lookup lookup;
+  char *path, *tz;
+  time_t *t, local;
+  long int *offsets;
+  size_t n, i, j, num_offsets;
+  int year, result = -1;
+
+  if (asprintf (&path, "%s/%s", check_dir, name) < 0)
+    return -1;
+  zone = tzfile_load (path, 0, NULL, 1, NULL);
+  if (zone == NULL)
+    {
+      report (name, "zic", 0, "%s: %s", path, strerror (errno));
+      free (path);
+      return 0;
+    }
+  if (asprintf (&tz, ":%s", path) < 0)
+    {
+      free (path);
+      tz_zone_close (zone);
+      return -1;
+    }
+  setenv ("TZ", tz, 1);
+  tzset ();
+  free (tz);
+  ++check_zones;
+
+  compiled = tz_zone_compile (source, name);
+  if (compiled == NULL)
+    report (name, "compile", 0, "%s", strerror (errno));
+  else
+    check_compiled (name, zone, compiled);
+
+  /* Both sides of every transition, then the sweep.  */
+  n = 2 * zone->num_transitions + (SWEEP_TO - SWEEP_FROM) / SWEEP_STEP + 1;
+  t = malloc (n * sizeof *t);
+  offsets = malloc ((zone->num_types + 2) * sizeof *offsets);
+  if (t == NULL || offsets == NULL)
+    goto out;
+  n = 0;
+  for (i = 0; i < zone->num_transitions; ++i)
+    {
+      t[n++] = zone_transition (zone, i) - 1;
+      t[n++] = zone_transition (zone, i);
+    }
+  for (local = SWEEP_FROM; local < SWEEP_TO; local += SWEEP_STEP)
+    t[n++] = local;
+
+  for (i = 0; i < n; ++i)
+    check_lookup (name, zone, compiled, t[i]);
+
+  num_offsets = 0;
+  for (i = 0; i < zone->num_types; ++i)
+    offsets[num_offsets++] = zone_type_offset (zone, i);
+  if (zone->rules != NULL)
+    {
+      offsets[num_offsets++] = zone->rules->offset[0];
+      offsets[num_offsets++] = zone->rules->offset[1];
+    }
+  for (i = 0; i < n; ++i)
+    if (tz_zone_lookup (zone, t[i], &lookup) == 0)
+      /* The wall times either side of each change, and around it.  */
+      for (j = 0; j < 3; ++j)
+	check_local (name, zone, t[i] + lookup.gmtoff + (time_t) j - 1,
+		     offsets, num_offsets);
+
+  check_image (name, zone, 0, 0, 0, t, n);
+  check_image (name, zone, 0, 0, TZ_WRITE_SLIM, t, n);
+  for (year = 1850; year < 2150; year += 25)
+    check_image (name, zone, year_start (year), year_start (year + 10),
+		 TZ_WRITE_WINDOW | TZ_WRITE_SLIM, t, n);
+
+  check_paths (name, path, zone, db, t, n);
+  if (check_batch (name, zone, t, n) == 0
+      && check_format (name, zone, t, n) == 0
+      && check_tai (name, zone, t, n) == 0)
+    result = 0;
+
+ out:
+  free (t);
+  free (offsets);
+  free (path);
+  tz_zone_close (compiled);
+  tz_zone_close (zone);
+  return result;
+}
+
+/* Check every Zone and Link named in the source file PATH.  Return 0,
+   1 if zic or tzdb_build could not be run, or -1 on other errors, with
+   errno set.  */
+static int
+check_file (const char *path)
+{
+  char *zic_argv[] = { "zic", "-b", "slim", "-d", check_dir,
+		       (char *) path, NULL };
+  char *build_argv[] = { check_tzdb_build, "-d", check_dir, check_db,
+			 NULL };
+  char *source, *text, *line, *end, *name;
+  struct tz_db *db = NULL;
+  int zic, result = -1;
+
+  source = read_source (path);
+  text = source != NULL ? strdup (source) : NULL;
+  if (text == NULL)
+    {
+      free (source);
+      return -1;
+    }
+  strcpy (check_dir, CHECK_DIR);
+  if (mkdtemp (check_dir) == NULL)
+    goto out_free;
+  /* For tz_zone_open_window, which only reads files under TZDIR.  */
+  setenv ("TZDIR", check_dir, 1);
+  zic = run (zic_argv);
+  if (zic < 0)
+    {
+      result = 1;
+      goto out;
+    }
+  /* The database is packed from what zic wrote, and put beside it.  */
+  if (zic == 0)
+    {
+      strcpy (stpcpy (check_db, check_dir), CHECK_DB);
+      if (run (build_argv) != 0)
+	{
+	  result = 1;
+	  goto out;
+	}
+      db = tz_db_open (check_db);
+      if (db == NULL)
+	goto out;
+    }
+
+  /* Zone NAME ... and Link TARGET NAME, which zic lets be shortened as
+     far as Z and L.  */
+  for (line = text; line != NULL; line = end)
+    {
+      char *keyword, *save;
+
+      end = strchr (line, '\n');
+      if (end != NULL)
+	*end++ = '\0';
+      keyword = strtok_r (line, " \t", &save);
+      if (keyword == NULL)
+	name = NULL;
+      else if (strncasecmp (keyword, "zone", strlen (keyword)) == 0)
+	name = strtok_r (NULL, " \t", &save);
+      else if (strncasecmp (keyword, "link", strlen (keyword)) == 0
+	       && strtok_r (NULL, " \t", &save) != NULL)
+	name = strtok_r (NULL, " \t", &save);
+      else
+	name = NULL;
+      if (name == NULL)
+	continue;
+      if (zic == 0)
+	{
+	  if (check_zone (source, db, name) != 0)
+	    goto out;
+	}
+      else
+	{
+	  /* What zic rejects must not compile either.  */
+	  struct tz_zone *compiled = tz_zone_compile (source, name);
+
+	  ++check_rejected;
+	  if (compiled != NULL || errno != EINVAL)
+	    report (name, "compile", 0, "%s, zic rejects %s",
+		    compiled != NULL ? "compiled" : strerror (errno), path);
+	  tz_zone_close (compiled);
+	}
+    }
+  result = 0;
+
+ out:
+  if (db != NULL)
+    tz_db_close (db);
+  nftw (check_dir, remove_one, 16, FTW_DEPTH | FTW_PHYS);
+ out_free:
+  free (text);
+  free (source);
+  return result;
+}
+
+int
+main (int argc, char *argv[])
+{
+  size_t num_files = sizeof check_files / sizeof check_files[0];
+  char *path, *slash;
+  int dir_len, r = -1;
+  size_t i;
+
+  /* The files that go with tzcheck are looked for beside it.  */
+  slash = strrchr (argv[0], '/');
+  dir_len = slash != NULL ? slash - argv[0] + 1 : 0;
+  if (asprintf (&check_tzdb_build, "%.*stzdb_build", dir_len, argv[0]) < 0)
+    goto fail;
+  /* The zone directory the sources come from, before TZDIR is set to
+     the files zic writes.  */
+  check_tzdir = strdup (tzfile_dir ());
+  if (check_tzdir == NULL)
+    goto fail;
+
+  for (i = 1; i < (size_t) argc; ++i)
+    if ((r = check_file (argv[i])) != 0)
+      {
+	fprintf (stderr, "%s: ", argv[i]);
+	goto fail;
+      }
+  for (i = 0; argc == 1 && i <= num_files; ++i)
+    {
+      if ((i == 0
+	   ? asprintf (&path, "%s/tzdata.zi", check_tzdir)
+	   : asprintf (&path, "%.*s%s", dir_len, argv[0],
+		       check_files[i - 1])) < 0)
+	goto fail;
+      r = check_file (path);
+      if (r != 0)
+	{
+	  fprintf (stderr, "%s: ", path);
+	  free (path);
+	  goto fail;
+	}
+      free (path);
+    }
+  if (check_leaps () != 0)
+    goto fail;
+
+  printf ("%zu zones, %zu checks, %zu gaps, %zu folds, %zu rejected: "
+	  "%zu mismatches\n", check_zones, check_checks, check_gaps,
+	  check_folds, check_rejected, check_bad);
+  return check_zones + check_rejected == 0 || check_bad != 0;
+
+ fail:
+  if (r > 0)
+    fprintf (stderr, "zic or %s could not be run\n", check_tzdb_build);
+  else
+    perror ("tzcheck");
+  return 2;
+}
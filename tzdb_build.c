@@ -0,0 +1,282 @@
+/* Build a packed zone database from a zoneinfo tree.
+
+   Every TZif file under the zone directory, $TZDIR or else the one
+   compiled in, is read with the library's own loader and written to
+   one file in the format described in tzzone-internal.h.  It is built
+   with the reader:
+
+	cc -O2 -o tzdb_build tzdb_build.c tzzone.c -lpthread
+
+   Usage: tzdb_build [-d TZDIR] OUTPUT  */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tzzone-internal.h"
+
+/* The zones found, before sorting.  */
+struct build_zone
+{
+  char *name;
+  struct tz_zone *zone;
+};
+
+static struct build_zone *build_zones;
+static size_t build_num_zones, build_max_zones;
+static const char *build_tzdir;
+
+/* The output, built in memory.  Tables are added through blob_add,
+   which stores identical ones only once.  */
+static unsigned char *out;
+static size_t out_size, out_max;
+static size_t bytes_shared;
+
+struct blob
+{
+  struct blob *next;
+  uint32_t hash;
+  size_t off, len;
+};
+
+#define BLOB_TABLE_SIZE 4093
+static struct blob *blob_table[BLOB_TABLE_SIZE];
+
+static void *
+xrealloc (void *p, size_t size)
+{
+  p = realloc (p, size);
+  if (p == NULL)
+    {
+      perror ("tzdb_build");
+      exit (1);
+    }
+  return p;
+}
+
+static void
+out_reserve (size_t len)
+{
+  if (out_size + len > out_max)
+    {
+      out_max = (out_size + len) * 2;
+      out = xrealloc (out, out_max);
+    }
+}
+
+static void
+encode (unsigned char *p, uint32_t v)
+{
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+static void
+encode64 (unsigned char *p, int64_t v)
+{
+  encode (p, (uint64_t) v >> 32);
+  encode (p + 4, (uint32_t) v);
+}
+
+/* Store LEN bytes from DATA at an offset aligned to ALIGN, unless the
+   same bytes are already stored at such an offset.  Returns the
+   offset.  */
+static uint32_t
+blob_add (const void *data, size_t len, size_t align)
+{
+  const unsigned char *d = data;
+  uint32_t hash = 2166136261u;
+  struct blob *b;
+  size_t i;
+
+  if (len == 0)
+    return 0;
+
+  for (i = 0; i < len; ++i)
+    hash = (hash ^ d[i]) * 16777619u;
+  for (b = blob_table[hash % BLOB_TABLE_SIZE]; b != NULL; b = b->next)
+    if (b->hash == hash && b->len == len && b->off % align == 0
+	&& memcmp (out + b->off, data, len) == 0)
+      {
+	bytes_shared += len;
+	return b->off;
+      }
+
+  out_reserve (len + align);
+  while (out_size % align != 0)
+    out[out_size++] = 0;
+
+  b = xrealloc (NULL, sizeof (struct blob));
+  b->hash = hash;
+  b->off = out_size;
+  b->len = len;
+  b->next = blob_table[hash % BLOB_TABLE_SIZE];
+  blob_table[hash % BLOB_TABLE_SIZE] = b;
+
+  memcpy (out + out_size, data, len);
+  out_size += len;
+  return b->off;
+}
+
+static int
+build_one (const char *path, const struct stat *sb, int flag,
+	   struct FTW *ftw)
+{
+  struct tz_zone *zone;
+  const char *name;
+
+  /* Symbolic links are loaded through, so link names get their own
+     records.  Links to directories fail to load and are skipped:
+     following them would make nftw skip the directories themselves
+     when it meets them again under their real names.  */
+  if (flag != FTW_F && flag != FTW_SL)
+    return 0;
+
+  /* Anything that is not a valid TZif file (zone.tab and friends) is
+     skipped.  */
+  zone = tzfile_load (path, 0, NULL, 1, NULL);
+  if (zone == NULL)
+    return 0;
+
+  name = path + strlen (build_tzdir);
+  while (*name == '/')
+    ++name;
+
+  if (build_num_zones == build_max_zones)
+    {
+      build_max_zones = build_max_zones * 2 + 64;
+      build_zones = xrealloc (build_zones,
+			      build_max_zones * sizeof (struct build_zone));
+    }
+  build_zones[build_num_zones].name = strdup (name);
+  build_zones[build_num_zones].zone = zone;
+  ++build_num_zones;
+  return 0;
+}
+
+static int
+build_compare (const void *a, const void *b)
+{
+  return strcmp (((const struct build_zone *) a)->name,
+		 ((const struct build_zone *) b)->name);
+}
+
+/* Add the tables of ZONE to the output and fill in record REC.  */
+static void
+build_record (size_t rec, const char *name, struct tz_zone *zone)
+{
+  size_t n = zone->num_transitions;
+  uint32_t f[TZDB_FIELDS];
+  unsigned char *tmp;
+  size_t i;
+  int k;
+
+  f[TZDB_NAME] = blob_add (name, strlen (name) + 1, 1);
+
+  /* Times are always stored with 8 bytes, whichever block of the file
+     the loader used.  */
+  tmp = xrealloc (NULL, n * 8 + zone->num_leaps * 12 + 1);
+  for (i = 0; i < n; ++i)
+    encode64 (tmp + i * 8, zone_transition (zone, i));
+  f[TZDB_TIMECNT] = n;
+  f[TZDB_TIMES] = blob_add (tmp, n * 8, 8);
+  f[TZDB_IDXS] = blob_add (zone->type_idxs, n, 1);
+
+  f[TZDB_TYPECNT] = zone->num_types;
+  f[TZDB_TYPES] = blob_add (zone->types, zone->num_types * 6, 1);
+  f[TZDB_CHARCNT] = zone->num_chars;
+  f[TZDB_CHARS] = blob_add (zone->zone_names, zone->num_chars, 1);
+
+  for (i = 0; i < zone->num_leaps; ++i)
+    {
+      encode64 (tmp + i * 12, zone_leap_transition (zone, i));
+      encode (tmp + i * 12 + 8, zone_leap_change (zone, i));
+    }
+  f[TZDB_LEAPCNT] = zone->num_leaps;
+  f[TZDB_LEAPS] = blob_add (tmp, zone->num_leaps * 12, 1);
+  free (tmp);
+
+  f[TZDB_ISSTDCNT] = zone->num_isstd;
+  f[TZDB_ISSTD] = blob_add (zone->isstd, zone->num_isstd, 1);
+  f[TZDB_ISGMTCNT] = zone->num_isgmt;
+  f[TZDB_ISGMT] = blob_add (zone->isgmt, zone->num_isgmt, 1);
+
+  f[TZDB_TZSPEC] = (zone->tzspec == NULL ? 0
+		    : blob_add (zone->tzspec, strlen (zone->tzspec) + 1, 1));
+
+  /* Only now, as adding tables may have moved the output.  */
+  for (k = 0; k < TZDB_FIELDS; ++k)
+    encode (out + TZDB_HEADER + (rec * TZDB_FIELDS + k) * 4, f[k]);
+}
+
+int
+main (int argc, char *argv[])
+{
+  const char *output;
+  char *tmpname;
+  size_t i, records;
+  FILE *f;
+
+  build_tzdir = tzfile_dir ();
+  if (argc == 4 && strcmp (argv[1], "-d") == 0)
+    {
+      build_tzdir = argv[2];
+      output = argv[3];
+    }
+  else if (argc == 2)
+    output = argv[1];
+  else
+    {
+      fprintf (stderr, "usage: %s [-d TZDIR] OUTPUT\n", argv[0]);
+      return 2;
+    }
+
+  if (nftw (build_tzdir, build_one, 16, FTW_PHYS) != 0)
+    {
+      perror (build_tzdir);
+      return 1;
+    }
+  qsort (build_zones, build_num_zones, sizeof (struct build_zone),
+	 build_compare);
+
+  /* Header and records first; the tables follow.  */
+  records = TZDB_HEADER + build_num_zones * TZDB_FIELDS * 4;
+  out_reserve (records);
+  memset (out, 0, records);
+  out_size = records;
+  for (i = 0; i < build_num_zones; ++i)
+    build_record (i, build_zones[i].name, build_zones[i].zone);
+
+  memcpy (out, TZDB_MAGIC, 4);
+  encode (out + 4, TZDB_VERSION);
+  encode (out + 8, build_num_zones);
+  encode (out + 12, out_size);
+
+  /* Write a temporary file and rename it into place, so that readers
+     never map a partial database.  */
+  if (asprintf (&tmpname, "%s.tmp", output) < 0)
+    {
+      perror ("tzdb_build");
+      return 1;
+    }
+  f = fopen (tmpname, "wb");
+  if (f == NULL
+      || fwrite (out, 1, out_size, f) != out_size
+      || fclose (f) != 0
+      || rename (tmpname, output) != 0)
+    {
+      fprintf (stderr, "%s: %s\n", output, strerror (errno));
+      unlink (tmpname);
+      return 1;
+    }
+
+  printf ("%zu zones, %zu bytes (%zu bytes of shared tables)\n",
+	  build_num_zones, out_size, bytes_shared);
+  return 0;
+}
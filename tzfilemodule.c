@@ -0,0 +1,316 @@
+/* Python bindings for the tzfile reader.
+
+   The module is built with the reader, and uses tzzone-internal.h like
+   the benchmarks, so that zones can be inspected as well as converted:
+
+	cc -O2 -shared -fPIC $(python3-config --includes) \
+	  -o _tzfile$(python3-config --extension-suffix) tzfilemodule.c \
+	  tzzone.c -lpthread
+
+   Usage:
+
+	import _tzfile, numpy
+	zone = _tzfile.Zone ("Europe/Paris")
+	offsets, isdst = zone.convert (numpy.array (times, dtype=numpy.int64))
+
+   convert accepts any C-contiguous buffer of signed 64-bit integers
+   without copying it, and converts it with the GIL released.  */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <structmember.h>
+
+#include "tzzone-internal.h"
+
+typedef struct
+{
+  PyObject_HEAD
+  struct tz_zone *zone;
+  PyObject *name;
+} ZoneObject;
+
+static PyObject *
+Zone_new (PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+  static char *kwlist[] = { "name", NULL };
+  const char *name;
+  struct tz_zone *zone;
+  ZoneObject *self;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "s:Zone", kwlist, &name))
+    return NULL;
+
+  Py_BEGIN_ALLOW_THREADS
+  zone = tz_zone_open (name);
+  Py_END_ALLOW_THREADS
+  if (zone == NULL)
+    {
+      PyErr_Format (PyExc_OSError, "cannot load time zone `%s'", name);
+      return NULL;
+    }
+
+  self = (ZoneObject *) type->tp_alloc (type, 0);
+  if (self == NULL)
+    {
+      tz_zone_close (zone);
+      return NULL;
+    }
+  self->zone = zone;
+  self->name = PyUnicode_FromString (name);
+  if (self->name == NULL)
+    {
+      Py_DECREF (self);
+      return NULL;
+    }
+  return (PyObject *) self;
+}
+
+static void
+Zone_dealloc (ZoneObject *self)
+{
+  tz_zone_close (self->zone);
+  Py_XDECREF (self->name);
+  Py_TYPE (self)->tp_free ((PyObject *) self);
+}
+
+static PyObject *
+Zone_repr (ZoneObject *self)
+{
+  return PyUnicode_FromFormat ("<_tzfile.Zone %R>", self->name);
+}
+
+/* Return nonzero if VIEW holds signed 64-bit integers in native byte
+   order.  */
+static int
+buffer_is_int64 (const Py_buffer *view)
+{
+  const char *f = view->format;
+
+  if (view->itemsize != 8 || f == NULL)
+    return 0;
+  if (*f == '@' || *f == '='
+      || (*f == '<' && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+      || (*f == '>' && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__))
+    ++f;
+  return (f[0] == 'q' || f[0] == 'l') && f[1] == '\0';
+}
+
+/* Return a writable memoryview of SIZE bytes cast to FORMAT, and the
+   start of its memory in *DATA.  */
+static PyObject *
+new_array (Py_ssize_t size, const char *format, char **data)
+{
+  PyObject *bytes, *view, *cast;
+
+  bytes = PyByteArray_FromStringAndSize (NULL, size);
+  if (bytes == NULL)
+    return NULL;
+  *data = PyByteArray_AS_STRING (bytes);
+  view = PyMemoryView_FromObject (bytes);
+  Py_DECREF (bytes);
+  if (view == NULL)
+    return NULL;
+  cast = PyObject_CallMethod (view, "cast", "s", format);
+  Py_DECREF (view);
+  return cast;
+}
+
+PyDoc_STRVAR (Zone_convert_doc,
+"convert(times) -> (offsets, isdst)\n\
+\n\
+Convert a buffer of int64 POSIX times.  Returns memoryviews of the UTC\n\
+offsets (int32) and DST flags (uint8) of each.");
+
+static PyObject *
+Zone_convert (ZoneObject *self, PyObject *arg)
+{
+  PyObject *offsets = NULL, *isdst = NULL, *result = NULL;
+  char *offsets_data, *isdst_data;
+  Py_buffer view;
+  size_t n;
+
+  if (sizeof (time_t) != 8)
+    {
+      PyErr_SetString (PyExc_NotImplementedError,
+		       "convert needs a 64-bit time_t");
+      return NULL;
+    }
+  if (PyObject_GetBuffer (arg, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT)
+      != 0)
+    return NULL;
+  if (!buffer_is_int64 (&view))
+    {
+      PyErr_SetString (PyExc_TypeError,
+		       "convert needs a buffer of int64 values");
+      goto out;
+    }
+  n = view.len / 8;
+
+  offsets = new_array (n * sizeof (int32_t), "i", &offsets_data);
+  if (offsets == NULL)
+    goto out;
+  isdst = new_array (n, "B", &isdst_data);
+  if (isdst == NULL)
+    goto out;
+
+  Py_BEGIN_ALLOW_THREADS
+  tz_compute_batch (self->zone, view.buf, n, (int32_t *) offsets_data,
+		    (uint8_t *) isdst_data, NULL);
+  Py_END_ALLOW_THREADS
+
+  result = PyTuple_Pack (2, offsets, isdst);
+
+ out:
+  Py_XDECREF (offsets);
+  Py_XDECREF (isdst);
+  PyBuffer_Release (&view);
+  return result;
+}
+
+PyDoc_STRVAR (Zone_lookup_doc,
+"lookup(time) -> (offset, isdst, abbreviation)\n\
+\n\
+Return the local time type in effect at a POSIX time.");
+
+static PyObject *
+Zone_lookup (ZoneObject *self, PyObject *arg)
+{
+  long long t;
+  struct tz_lookup result;
+
+  t = PyLong_AsLongLong (arg);
+  if (t == -1 && PyErr_Occurred ())
+    return NULL;
+  if (tz_zone_lookup (self->zone, (time_t) t, &result) != 0)
+    return PyErr_SetFromErrno (PyExc_OSError);
+  return Py_BuildValue ("(lOs)", result.gmtoff,
+			result.isdst ? Py_True : Py_False, result.abbr);
+}
+
+/* Return type I of the zone as (offset, isdst, abbreviation).  */
+static PyObject *
+zone_type_tuple (const struct tz_zone *zone, size_t i)
+{
+  return Py_BuildValue ("(lOs)", zone_type_offset (zone, i),
+			zone_type_isdst (zone, i) ? Py_True : Py_False,
+			&zone->zone_names[zone_type_idx (zone, i)]);
+}
+
+PyDoc_STRVAR (Zone_types_doc,
+"types() -> list of (offset, isdst, abbreviation)\n\
+\n\
+Return the local time types of the zone file.");
+
+static PyObject *
+Zone_types (ZoneObject *self, PyObject *unused)
+{
+  const struct tz_zone *zone = self->zone;
+  PyObject *list;
+  size_t i;
+
+  list = PyList_New (zone->num_types);
+  if (list == NULL)
+    return NULL;
+  for (i = 0; i < zone->num_types; ++i)
+    {
+      PyObject *item = zone_type_tuple (zone, i);
+
+      if (item == NULL)
+	{
+	  Py_DECREF (list);
+	  return NULL;
+	}
+      PyList_SET_ITEM (list, i, item);
+    }
+  return list;
+}
+
+PyDoc_STRVAR (Zone_transitions_doc,
+"transitions() -> list of (time, type index)\n\
+\n\
+Return the transitions of the zone file, as indices into types().");
+
+static PyObject *
+Zone_transitions (ZoneObject *self, PyObject *unused)
+{
+  const struct tz_zone *zone = self->zone;
+  PyObject *list;
+  size_t i;
+
+  list = PyList_New (zone->num_transitions);
+  if (list == NULL)
+    return NULL;
+  for (i = 0; i < zone->num_transitions; ++i)
+    {
+      PyObject *item = Py_BuildValue ("(Li)",
+				      (long long) zone_transition (zone, i),
+				      zone->type_idxs[i]);
+
+      if (item == NULL)
+	{
+	  Py_DECREF (list);
+	  return NULL;
+	}
+      PyList_SET_ITEM (list, i, item);
+    }
+  return list;
+}
+
+static PyMethodDef Zone_methods[] =
+  {
+    { "convert", (PyCFunction) Zone_convert, METH_O, Zone_convert_doc },
+    { "lookup", (PyCFunction) Zone_lookup, METH_O, Zone_lookup_doc },
+    { "types", (PyCFunction) Zone_types, METH_NOARGS, Zone_types_doc },
+    { "transitions", (PyCFunction) Zone_transitions, METH_NOARGS,
+      Zone_transitions_doc },
+    { NULL }
+  };
+
+static PyMemberDef Zone_members[] =
+  {
+    { "name", T_OBJECT_EX, offsetof (ZoneObject, name), READONLY,
+      "the name the zone was opened with" },
+    { NULL }
+  };
+
+static PyTypeObject ZoneType =
+  {
+    PyVarObject_HEAD_INIT (NULL, 0)
+    .tp_name = "_tzfile.Zone",
+    .tp_doc = "Zone(name) -- a time zone loaded from TZDIR",
+    .tp_basicsize = sizeof (ZoneObject),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = Zone_new,
+    .tp_dealloc = (destructor) Zone_dealloc,
+    .tp_repr = (reprfunc) Zone_repr,
+    .tp_methods = Zone_methods,
+    .tp_members = Zone_members,
+  };
+
+static struct PyModuleDef tzfile_module =
+  {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "_tzfile",
+    .m_doc = "Time zones read with the tzfile reader.",
+    .m_size = -1,
+  };
+
+PyMODINIT_FUNC
+PyInit__tzfile (void)
+{
+  PyObject *m;
+
+  if (PyType_Ready (&ZoneType) < 0)
+    return NULL;
+  m = PyModule_Create (&tzfile_module);
+  if (m == NULL)
+    return NULL;
+  Py_INCREF (&ZoneType);
+  if (PyModule_AddObject (m, "Zone", (PyObject *) &ZoneType) < 0)
+    {
+      Py_DECREF (&ZoneType);
+      Py_DECREF (m);
+      return NULL;
+    }
+  return m;
+}
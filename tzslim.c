@@ -0,0 +1,220 @@
+/* Write a zoneinfo tree again in slim form, optionally cut down to a
+   window of years.
+
+   Every TZif file under the zone directory, $TZDIR or else the one
+   compiled in, is read with the library's own loader and written under
+   OUTDIR with tz_zone_image.  It is built with the reader:
+
+	cc -O2 -o tzslim tzslim.c tzzone.c -lpthread
+
+   The version 1 data block is left empty, and transitions the TZ
+   string reproduces are dropped.  With -w, only what lookups from the
+   start of year FROM (UTC) to the end of year TO need is kept.  Hard
+   links and symbolic links are written as links again; other files
+   (zone.tab and friends) are skipped.
+
+   Usage: tzslim [-d TZDIR] [-w FROM-TO] OUTDIR  */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tzzone-internal.h"
+
+static const char *slim_tzdir;
+static const char *slim_outdir;
+static time_t slim_from, slim_to;
+static int slim_flags = TZ_WRITE_SLIM;
+
+static size_t slim_zones, slim_links, slim_skipped;
+static size_t bytes_in, bytes_out;
+
+/* Files written, so that hard links are written as links too.  */
+struct slim_file
+{
+  dev_t dev;
+  ino_t ino;
+  char *path;
+};
+
+static struct slim_file *slim_files;
+static size_t slim_num_files, slim_max_files;
+
+static int
+slim_error (const char *path)
+{
+  fprintf (stderr, "%s: %s\n", path, strerror (errno));
+  return 1;
+}
+
+/* Write SIZE bytes of IMAGE to PATH through a temporary file.  */
+static int
+slim_write (const char *path, const void *image, size_t size)
+{
+  char *tmpname;
+  FILE *f;
+
+  if (asprintf (&tmpname, "%s.tmp", path) < 0)
+    return slim_error (path);
+  f = fopen (tmpname, "wb");
+  if (f == NULL
+      || fwrite (image, 1, size, f) != size
+      || fclose (f) != 0
+      || rename (tmpname, path) != 0)
+    {
+      slim_error (path);
+      unlink (tmpname);
+      free (tmpname);
+      return 1;
+    }
+  free (tmpname);
+  return 0;
+}
+
+static int
+slim_one (const char *path, const struct stat *sb, int flag,
+	  struct FTW *ftw)
+{
+  struct tz_zone *zone;
+  char *out;
+  void *image;
+  size_t i, size;
+  int result = 0;
+
+  if (asprintf (&out, "%s/%s", slim_outdir,
+		path + strlen (slim_tzdir)) < 0)
+    return slim_error (path);
+
+  if (flag == FTW_D)
+    {
+      if (mkdir (out, 0755) != 0 && errno != EEXIST)
+	result = slim_error (out);
+      free (out);
+      return result;
+    }
+
+  if (flag == FTW_SL)
+    {
+      char target[PATH_MAX];
+      ssize_t len = readlink (path, target, sizeof target - 1);
+
+      if (len < 0)
+	result = slim_error (path);
+      else
+	{
+	  target[len] = '\0';
+	  unlink (out);
+	  if (symlink (target, out) != 0)
+	    result = slim_error (out);
+	  else
+	    ++slim_links;
+	}
+      free (out);
+      return result;
+    }
+
+  if (flag != FTW_F)
+    {
+      free (out);
+      return 0;
+    }
+
+  for (i = 0; i < slim_num_files; ++i)
+    if (slim_files[i].dev == sb->st_dev && slim_files[i].ino == sb->st_ino)
+      {
+	unlink (out);
+	if (link (slim_files[i].path, out) != 0)
+	  result = slim_error (out);
+	else
+	  ++slim_links;
+	free (out);
+	return result;
+      }
+
+  zone = tzfile_load (path, 0, NULL, 1, NULL);
+  if (zone == NULL)
+    {
+      ++slim_skipped;
+      free (out);
+      return 0;
+    }
+  image = tz_zone_image (zone, slim_from, slim_to, slim_flags, &size);
+  if (image == NULL)
+    result = slim_error (path);
+  else if ((result = slim_write (out, image, size)) == 0)
+    {
+      ++slim_zones;
+      bytes_in += zone->map_size;
+      bytes_out += size;
+    }
+  free (image);
+  tz_zone_close (zone);
+
+  if (result == 0)
+    {
+      if (slim_num_files == slim_max_files)
+	{
+	  slim_max_files = slim_max_files * 2 + 64;
+	  slim_files = realloc (slim_files,
+				slim_max_files * sizeof (struct slim_file));
+	  if (slim_files == NULL)
+	    return slim_error ("tzslim");
+	}
+      slim_files[slim_num_files].dev = sb->st_dev;
+      slim_files[slim_num_files].ino = sb->st_ino;
+      slim_files[slim_num_files++].path = out;
+    }
+  else
+    free (out);
+  return result;
+}
+
+int
+main (int argc, char *argv[])
+{
+  int c, from, to, result;
+
+  slim_tzdir = tzfile_dir ();
+  while ((c = getopt (argc, argv, "d:w:")) != -1)
+    switch (c)
+      {
+      case 'd':
+	slim_tzdir = optarg;
+	break;
+      case 'w':
+	if (sscanf (optarg, "%d-%d", &from, &to) != 2 || from > to)
+	  goto usage;
+	slim_from = year_start (from);
+	slim_to = year_start (to + 1);
+	slim_flags |= TZ_WRITE_WINDOW;
+	break;
+      default:
+	goto usage;
+      }
+  if (optind + 1 != argc)
+    {
+    usage:
+      fprintf (stderr, "usage: %s [-d TZDIR] [-w FROM-TO] OUTDIR\n",
+	       argv[0]);
+      return 2;
+    }
+  slim_outdir = argv[optind];
+
+  /* Errors from slim_one have been reported already.  */
+  result = nftw (slim_tzdir, slim_one, 16, FTW_PHYS);
+  if (result != 0)
+    {
+      if (result < 0)
+	perror (slim_tzdir);
+      return 1;
+    }
+
+  printf ("%zu zones, %zu bytes in, %zu bytes out; %zu links, "
+	  "%zu other files skipped\n",
+	  slim_zones, bytes_in, bytes_out, slim_links, slim_skipped);
+  return 0;
+}
@@ -0,0 +1,378 @@
+/* Internal interface of the tzfile reader in tzzone.c.
+
+   Programs that only convert times need tzzone.h alone.  The tools
+   built with the reader (tzbench, tzcheck, tzdb_build, tzslim and the
+   Python module) look inside zones as well, and get from here the zone
+   structure, the accessors for its coded tables, and the functions
+   they call besides those of tzzone.h.
+
+   The layout of struct tz_zone depends on TZ_STATS, so a tool must be
+   built with the same setting as tzzone.c.  */
+
+#ifndef TZZONE_INTERNAL_H
+#define TZZONE_INTERNAL_H
+
+#include <endian.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include "tzfile.h"
+#include "tzzone.h"
+
+/* A loaded time zone.  All the data __tzfile_read reads from a file
+   lives here rather than in file-level statics, so that any number of
+   zones can be held at once.
+
+   The file is mapped read-only and the tables point straight into the
+   mapping, still in their on-disk encoding; use the zone_* accessors
+   below to read them.  A compact zone (see tz_zone_compact) keeps its
+   transitions and types in a denser form of its own instead.  */
+struct tz_compact;
+
+struct tz_zone
+{
+  struct tz_zone *next;		/* Chain in `zone_table'.  */
+  char *name;			/* Registry key; NULL if not registered.  */
+  unsigned int refcount;
+
+  /* A registered zone is also hashed by its content, and other names
+     whose files hold the same zone share it as its ALIASES.  */
+  struct tz_zone *content_next;	/* Chain in `content_table'.  */
+  uint64_t content_hash;
+  struct tz_alias *aliases;
+
+  /* The file the zone was read from, or NULL, and its identity.  */
+  char *path;
+  dev_t dev;
+  ino_t ino;
+  time_t mtime;
+
+  void *map;			/* The mapped file, or NULL.  */
+  size_t map_size;
+  int map_heap;			/* MAP is a malloc'd image, not a file.  */
+  struct tz_db *db;		/* Database holding the tables, or NULL.  */
+  int trans_width;		/* 4 or 8 bytes per coded time.  */
+
+  size_t num_transitions;
+  const unsigned char *transitions;	/* Coded transition times.  */
+  const unsigned char *type_idxs;
+  size_t num_types;
+  const unsigned char *types;	/* Coded ttinfo: offset[4], isdst, idx.  */
+  size_t num_chars;
+  const char *zone_names;
+  size_t num_leaps;
+  const unsigned char *leaps;	/* Coded time, then correction[4].  */
+  size_t num_isstd;
+  const unsigned char *isstd;
+  size_t num_isgmt;
+  const unsigned char *isgmt;
+
+  /* The decoded transition times in Eytzinger (breadth-first) order,
+     1-based, for searching; EYTZ_POS maps each slot back to its index
+     in `transitions'.  The array is aligned so that the eight
+     descendants three levels below slot K share one cache line.  */
+  time_t *eytz;
+  uint32_t *eytz_pos;
+
+  /* The compact encoding, which replaces the coded transition times
+     and types, the search layout and TZNAMES below; or NULL.  */
+  struct tz_compact *compact;
+
+  /* The direct index of the transitions, with buckets of 2^INDEX_SHIFT
+     seconds; &INDEX_WANTED until the first lookup builds it, or NULL
+     if the zone has none (see tz_zone_set_index).  An index is never
+     changed once it is published; one that is dropped goes on
+     INDEX_OLD until the zone is freed, so lookups need no lock, and
+     is published again if its shift is.  */
+  int index_shift;
+  struct tz_index *index;
+  struct tz_index *index_old;
+
+  /* The (standard, daylight) names to report for each transition
+     slot: TZNAMES[I] applies between transitions I - 1 and I, and
+     TZNAMES[0] before the first one.  BEFORE_TYPE is the type used
+     before the first transition.  */
+  char *(*tznames)[2];
+  int before_type;
+
+  long int rule_stdoff;
+  long int rule_dstoff;
+  long int max_offset;		/* Largest |UTC offset| of any type.  */
+  char *tzspec;
+  struct tz_rules *rules;	/* TZSPEC compiled, or NULL.  */
+  struct tz_strtab *strings;	/* The zone's strings, or NULL if they
+				   were given to __tzstring.  */
+  char *extra;			/* Caller's block from __tzfile_read.  */
+
+  /* Standard and daylight names to install as __tzname when this
+     zone becomes the process zone.  */
+  char *tzname[2];
+
+  /* A zone loaded for a window answers lookups in [WINDOW_FROM,
+     WINDOW_TO) only; its tables hold just the transitions those
+     need.  */
+  int windowed;
+  time_t window_from, window_to;
+
+#ifdef TZ_STATS
+  struct tz_counters counters;	/* Lookups in this zone.  */
+#endif
+};
+
+/* A zone in compact form.  Transition times are 32-bit deltas from
+   the start of their block; a new block starts only where the next
+   time is too far from the base for that, so most zones have one.
+   Types are split into arrays of offsets, flags and name indices.
+   SLOT_ABBRS gives, as TZNAMES does, the standard and daylight names
+   of each transition slot, as indices into the zone's names.  */
+struct tz_compact
+{
+  size_t num_blocks;
+  const time_t *base;			/* First time of each block.  */
+  const uint32_t *block_first;		/* First transition of each
+					   block, then the count.  */
+  const uint32_t *delta;		/* Each time less its base.  */
+  const int32_t *utoff;			/* Each type's UTC offset,  */
+  const unsigned char *isdst;		/* DST flag  */
+  const unsigned char *abbrind;		/* and name index.  */
+  unsigned char (*slot_abbrs)[2];
+  size_t size;				/* Bytes in this allocation.  */
+};
+
+/* A range of instants [FROM, TO) to load a zone for.  */
+struct tz_window
+{
+  time_t from, to;
+};
+
+/* One end of daylight saving time in a POSIX TZ string.  */
+struct tz_rule
+{
+  enum { J0, J1, M } type;	/* Interpretation of the fields below.  */
+  unsigned short int m, n, d;	/* Month, week, day.  */
+  int secs;			/* Local time of day of the change.  */
+};
+
+/* A compiled POSIX TZ string.  */
+struct tz_rules
+{
+  char *name[2];		/* Standard and daylight names.  */
+  long int offset[2];		/* Seconds east of UTC.  */
+  int has_dst;
+  struct tz_rule rule[2];	/* Start and end of daylight time.  */
+
+  /* The years worked out so far.  A table is never changed once it is
+     published; to cover more years a new one replaces it, and the old
+     ones are kept until the zone is freed, so lookups need no lock.  */
+  struct tz_rule_years *years;
+  pthread_mutex_t lock;		/* Serializes replacing `years'.  */
+};
+
+static inline int
+decode (const void *ptr)
+{
+    /*
+    if ((BYTE_ORDER == BIG_ENDIAN) && sizeof (int) == 4)//
+        return *(const int *) ptr;
+    else if (BYTE_ORDER == LITTLE_ENDIAN && sizeof (int) == 4)
+        return bswap_32 (*(const int *) ptr);
+    else
+    */
+    {
+        const unsigned char *p = ptr;
+        int result = *p & (1 << (CHAR_BIT - 1)) ? ~0 : 0;
+
+        result = (result << 8) | *p++;
+        result = (result << 8) | *p++;
+        result = (result << 8) | *p++;
+        result = (result << 8) | *p++;
+
+        return result;
+    }
+}
+
+static inline int64_t
+decode64 (const void *ptr)
+{
+  uint64_t v;
+
+  memcpy (&v, ptr, sizeof (v));
+  if (BYTE_ORDER != BIG_ENDIAN)
+    v = __builtin_bswap64 (v);
+  return (int64_t) v;
+}
+
+/* Accessors for the coded tables of a mapped zone, or the tables of a
+   compact one.  */
+
+/* Return the block of compact transition I.  */
+static inline size_t
+compact_block (const struct tz_compact *c, size_t i)
+{
+  size_t k = c->num_blocks - 1;
+
+  while (k > 0 && c->block_first[k] > i)
+    --k;
+  return k;
+}
+
+static inline time_t
+zone_transition (const struct tz_zone *zone, size_t i)
+{
+  const unsigned char *p;
+
+  if (__builtin_expect (zone->compact != NULL, 0))
+    {
+      const struct tz_compact *c = zone->compact;
+
+      return c->base[compact_block (c, i)] + c->delta[i];
+    }
+  p = zone->transitions + i * zone->trans_width;
+  if (sizeof (time_t) == 8 && zone->trans_width == 8)
+    return (time_t) decode64 (p);
+  return (time_t) decode (p);
+}
+
+static inline long int
+zone_type_offset (const struct tz_zone *zone, size_t type)
+{
+  if (__builtin_expect (zone->compact != NULL, 0))
+    return zone->compact->utoff[type];
+  return (long int) decode (zone->types + type * 6);
+}
+
+static inline int
+zone_type_isdst (const struct tz_zone *zone, size_t type)
+{
+  if (__builtin_expect (zone->compact != NULL, 0))
+    return zone->compact->isdst[type];
+  return zone->types[type * 6 + 4];
+}
+
+static inline int
+zone_type_idx (const struct tz_zone *zone, size_t type)
+{
+  if (__builtin_expect (zone->compact != NULL, 0))
+    return zone->compact->abbrind[type];
+  return zone->types[type * 6 + 5];
+}
+
+static inline int
+zone_type_isstd (const struct tz_zone *zone, size_t type)
+{
+  return type < zone->num_isstd && zone->isstd[type] != 0;
+}
+
+static inline int
+zone_type_isgmt (const struct tz_zone *zone, size_t type)
+{
+  return type < zone->num_isgmt && zone->isgmt[type] != 0;
+}
+
+static inline time_t
+zone_leap_transition (const struct tz_zone *zone, size_t i)
+{
+  const unsigned char *p = zone->leaps + i * (zone->trans_width + 4);
+
+  if (sizeof (time_t) == 8 && zone->trans_width == 8)
+    return (time_t) decode64 (p);
+  return (time_t) decode (p);
+}
+
+static inline long int
+zone_leap_change (const struct tz_zone *zone, size_t i)
+{
+  return (long int) decode (zone->leaps + i * (zone->trans_width + 4)
+			    + zone->trans_width);
+}
+
+/* Return the number of days from 1970-01-01 to YEAR-MONTH-DAY in the
+   proleptic Gregorian calendar.  MONTH is 1-based.  */
+static inline long long int
+days_from_civil (long long int year, unsigned int month, unsigned int day)
+{
+  long long int era;
+  unsigned int yoe, doy, doe;
+
+  year -= month <= 2;
+  era = (year >= 0 ? year : year - 399) / 400;
+  yoe = (unsigned int) (year - era * 400);
+  doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + (long long int) doe - 719468;
+}
+
+static inline time_t
+year_start (int year)
+{
+  return (time_t) days_from_civil (year, 1, 1) * SECSPERDAY;
+}
+
+/* Packed zone databases, as written by tzdb_build.
+
+   All numbers are 4-byte big-endian unsigned integers.  The file
+   starts with a header of four of them:
+
+	"TZdb"  version  zonecnt  size
+
+   followed by ZONECNT zone records sorted by name (in strcmp order),
+   each of TZDB_FIELDS numbers as listed below.  The tables use the
+   encoding of the 64-bit data block of a TZif file; transition times
+   start at 8-byte aligned offsets.  Offsets are from the start of the
+   file, and identical tables are stored once and shared by all the
+   records that use them.  */
+
+#define TZDB_MAGIC	"TZdb"
+#define TZDB_VERSION	1
+#define TZDB_HEADER	16
+
+enum
+  {
+    TZDB_NAME,			/* Offset of the NUL-terminated name.  */
+    TZDB_TIMECNT, TZDB_TIMES,	/* Transition times, 8 bytes each.  */
+    TZDB_IDXS,			/* TIMECNT type indices.  */
+    TZDB_TYPECNT, TZDB_TYPES,	/* Coded ttinfo, 6 bytes each.  */
+    TZDB_CHARCNT, TZDB_CHARS,	/* Abbreviations.  */
+    TZDB_LEAPCNT, TZDB_LEAPS,	/* Coded leap records, 12 bytes each.  */
+    TZDB_ISSTDCNT, TZDB_ISSTD,
+    TZDB_ISGMTCNT, TZDB_ISGMT,
+    TZDB_TZSPEC,		/* NUL-terminated TZ string, or 0.  */
+    TZDB_FIELDS
+  };
+
+/* The zone behind the legacy __tzfile_read/__tzfile_compute API.  */
+extern struct tz_zone *tzfile_zone;
+extern int __use_tzfile;
+
+extern void __tzfile_read (const char *file, size_t extra, char **extrap);
+extern void __tzfile_compute (time_t timer, int use_localtime,
+			      long int *leap_correct, int *leap_hit,
+			      struct tm *tp);
+extern char *__tzstring (const char *s);
+
+/* Return the directory relative zone names are looked up in: $TZDIR,
+   or else TZDIR.  */
+extern const char *tzfile_dir (void);
+
+/* Make a new, unregistered zone from the SIZE bytes of TZif data at
+   MAP, or from the file at PATH; see tzzone.c.  Release it with
+   tzfile_free, or with tz_zone_close.  Set MAP_HEAP in a zone parsed
+   from a malloc'd image to have the image freed with it.  */
+extern struct tz_zone *tzfile_parse (const void *map, size_t map_size,
+				     size_t extra, char **extrap,
+				     int private_strings,
+				     const struct tz_window *window);
+extern struct tz_zone *tzfile_load (const char *path, size_t extra,
+				    char **extrap, int private_strings,
+				    const struct tz_window *window);
+extern void tzfile_free (struct tz_zone *zone);
+
+/* Return the index of the first transition of ZONE after TIMER, as
+   the lookups find it.  TIMER must not be before the first transition
+   or after the last one.  */
+extern size_t __tzfile_search (const struct tz_zone *zone, time_t timer);
+
+#endif /* tzzone-internal.h */
@@ -0,0 +1,6005 @@
+/* nftw, pipe2 and mempcpy are GNU extensions.  */
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <assert.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <ftw.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#if defined __x86_64__
+#include <immintrin.h>
+#endif
+#include "tzzone-internal.h"
+
+#ifndef TZDIR
+#define TZDIR "/usr/share/zoneinfo"
+#endif
+
+extern char * __tzname[2];
+
+/* Instrumentation.  With TZ_STATS defined, the lookup paths, loads and
+   reloads are counted, per zone and for the process; see tz_counters.
+   Without it the counters are compiled out.  USDT probes in provider
+   `tzfile' mark the same events whenever <sys/sdt.h> is available;
+   each is a nop until perf or bpftrace attaches to it.
+
+   The process counts are kept per thread, like the reader records of
+   __tzfile_compute, so that they need no locked instruction; a
+   thread's counts are added to `tz_exited_counters' when it exits.
+   Zone counts are shared, and atomic.  */
+#ifdef TZ_STATS
+struct tz_thread_counters
+{
+  struct tz_thread_counters *next;
+  int registered;
+  struct tz_counters counters;
+};
+
+static struct tz_thread_counters *tz_counting_threads;
+static struct tz_counters tz_exited_counters;
+static pthread_mutex_t tz_counters_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct tz_thread_counters tz_thread_counters;
+
+static void counters_register (struct tz_thread_counters *t);
+
+# define TZ_COUNT_PROCESS(field)					\
+  do									\
+    {									\
+      struct tz_thread_counters *t_ = &tz_thread_counters;		\
+									\
+      if (__builtin_expect (!t_->registered, 0))			\
+	counters_register (t_);						\
+      __atomic_store_n (&t_->counters.field, t_->counters.field + 1,	\
+			__ATOMIC_RELAXED);				\
+    }									\
+  while (0)
+# define TZ_COUNT(zone, field)						\
+  do									\
+    {									\
+      __atomic_add_fetch (&((struct tz_zone *) (zone))->counters.field,	\
+			  1, __ATOMIC_RELAXED);				\
+      TZ_COUNT_PROCESS (field);						\
+    }									\
+  while (0)
+#else
+# define TZ_COUNT_PROCESS(field) ((void) 0)
+# define TZ_COUNT(zone, field) ((void) 0)
+#endif
+
+#if defined __has_include
+# if __has_include (<sys/sdt.h>)
+#  include <sys/sdt.h>
+#  define TZ_PROBE(...) STAP_PROBEV (tzfile, __VA_ARGS__)
+# endif
+#endif
+#ifndef TZ_PROBE
+# define TZ_PROBE(...) ((void) 0)
+#endif
+
+int __use_tzfile;
+
+/* Interned time zone strings.
+
+   Strings are copied into arena blocks that are only ever appended to,
+   and found again through an open-addressed hash index.  Every suffix
+   of a stored string is indexed as well, so a string that is the tail
+   of one already stored shares its bytes.
+
+   The table behind __tzstring is permanent, since __tzname and tm_zone
+   may point into it at any time.  Registered zones get a table of their
+   own, which goes away with the zone.  */
+
+/* Arena blocks start small, as one zone has only a few dozen bytes of
+   names, and double up to STRTAB_BLOCK.  */
+#define STRTAB_FIRST_BLOCK 64
+#define STRTAB_BLOCK 4096
+
+struct tz_strblock
+{
+  struct tz_strblock *next;
+  size_t used, size;
+  char data[];
+};
+
+struct tz_strent
+{
+  const char *s;		/* NULL if the slot is free.  */
+  uint32_t hash;
+};
+
+struct tz_strtab
+{
+  struct tz_strblock *blocks;	/* Newest first.  */
+  struct tz_strent *index;
+  size_t mask;			/* Index slots - 1.  */
+  size_t entries;		/* Index slots in use.  */
+  struct tz_string_stats stats;
+};
+
+static struct tz_strtab tzstrings;
+static pthread_mutex_t tzstrings_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint32_t
+strtab_hash (const char *s, size_t len)
+{
+  uint32_t hash = 2166136261u;
+
+  while (len-- > 0)
+    hash = (hash ^ (unsigned char) *s++) * 16777619u;
+  return hash;
+}
+
+/* Return the slot holding S, or the free slot where it belongs.  */
+static struct tz_strent *
+strtab_slot (const struct tz_strtab *tab, const char *s, uint32_t hash)
+{
+  size_t i;
+
+  for (i = hash & tab->mask; tab->index[i].s != NULL; i = (i + 1) & tab->mask)
+    if (tab->index[i].hash == hash && strcmp (tab->index[i].s, s) == 0)
+      break;
+  return &tab->index[i];
+}
+
+/* Make room in the index of TAB for NEED more entries, keeping it at
+   most three quarters full.  */
+static int
+strtab_reserve (struct tz_strtab *tab, size_t need)
+{
+  struct tz_strent *old = tab->index;
+  size_t old_size = old == NULL ? 0 : tab->mask + 1;
+  size_t size = old_size == 0 ? 16 : old_size;
+  size_t i;
+
+  while ((tab->entries + need) * 4 > size * 3)
+    size *= 2;
+  if (size == old_size)
+    return 0;
+
+  tab->index = calloc (size, sizeof (struct tz_strent));
+  if (tab->index == NULL)
+    {
+      tab->index = old;
+      return -1;
+    }
+  tab->mask = size - 1;
+  for (i = 0; i < old_size; ++i)
+    if (old[i].s != NULL)
+      *strtab_slot (tab, old[i].s, old[i].hash) = old[i];
+  free (old);
+  tab->stats.index_slots = size;
+  return 0;
+}
+
+/* Return the copy of S in TAB, storing it if there is none.  Returns
+   NULL if memory runs out.  */
+static char *
+strtab_intern (struct tz_strtab *tab, const char *s)
+{
+  size_t len = strlen (s);
+  uint32_t hash = strtab_hash (s, len);
+  struct tz_strblock *b;
+  struct tz_strent *e;
+  char *p;
+  size_t i;
+
+  ++tab->stats.lookups;
+  if (tab->index != NULL)
+    {
+      e = strtab_slot (tab, s, hash);
+      if (e->s != NULL)
+	{
+	  ++tab->stats.hits;
+	  return (char *) e->s;
+	}
+    }
+
+  /* Not found; copy it into the arena, and index it together with all
+     its suffixes.  */
+  if (strtab_reserve (tab, len + 1) != 0)
+    return NULL;
+  b = tab->blocks;
+  if (b == NULL || b->size - b->used < len + 1)
+    {
+      size_t size = b == NULL ? STRTAB_FIRST_BLOCK : b->size * 2;
+
+      if (size > STRTAB_BLOCK)
+	size = STRTAB_BLOCK;
+      if (size < len + 1)
+	size = len + 1;
+
+      b = malloc (sizeof (struct tz_strblock) + size);
+      if (b == NULL)
+	return NULL;
+      b->next = tab->blocks;
+      b->used = 0;
+      b->size = size;
+      tab->blocks = b;
+      ++tab->stats.blocks;
+      tab->stats.arena_bytes += size;
+    }
+  p = memcpy (b->data + b->used, s, len + 1);
+  b->used += len + 1;
+  ++tab->stats.strings;
+  tab->stats.bytes += len + 1;
+
+  for (i = 0; i <= len; ++i)
+    {
+      uint32_t h = i == 0 ? hash : strtab_hash (p + i, len - i);
+
+      e = strtab_slot (tab, p + i, h);
+      if (e->s == NULL)
+	{
+	  e->s = p + i;
+	  e->hash = h;
+	  ++tab->entries;
+	}
+    }
+  return p;
+}
+
+static struct tz_strtab *
+strtab_new (void)
+{
+  return calloc (1, sizeof (struct tz_strtab));
+}
+
+static void
+strtab_free (struct tz_strtab *tab)
+{
+  struct tz_strblock *b, *next;
+
+  if (tab == NULL)
+    return;
+  for (b = tab->blocks; b != NULL; b = next)
+    {
+      next = b->next;
+      free (b);
+    }
+  free (tab->index);
+  free (tab);
+}
+
+/* Allocate a permanent home for S.  It will never be moved or deallocated,
+   but may share space with other strings.
+   Don't modify the returned string. */
+char *
+__tzstring (const char *s)
+{
+  char *p;
+
+  pthread_mutex_lock (&tzstrings_lock);
+  p = strtab_intern (&tzstrings, s);
+  pthread_mutex_unlock (&tzstrings_lock);
+  return p;
+}
+
+/* Intern S in STRINGS, or permanently if STRINGS is NULL.  */
+static char *
+tz_intern (struct tz_strtab *strings, const char *s)
+{
+  return strings != NULL ? strtab_intern (strings, s) : __tzstring (s);
+}
+
+/* A direct index of the transitions of a zone.  Time from BASE on is
+   cut into buckets of 2^SHIFT seconds; for each, FIRST is the index of
+   the first transition after its start, and NEXT how far after the
+   start that transition is, or UINT32_MAX if not within 2^32 seconds.
+   BASE is the time of a transition, the first one unless that would
+   take more than INDEX_MAX_BUCKETS buckets.  */
+struct tz_index_bucket
+{
+  uint32_t first;
+  uint32_t next;
+};
+
+struct tz_index
+{
+  struct tz_index *prev;		/* Next older index, on INDEX_OLD.  */
+  time_t base;
+  int shift;
+  size_t num_buckets;
+  struct tz_index_bucket bucket[];
+};
+
+#define INDEX_MAX_BUCKETS (1 << 20)
+
+/* Stands for the index of a zone that wants one not built yet.  */
+static struct tz_index index_wanted;
+
+/* Serializes building and dropping the indices of all zones.  */
+static pthread_mutex_t zone_index_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The zone behind the legacy __tzfile_read/__tzfile_compute API.  It
+   is not entered in the registry.  Readers load it atomically inside
+   reader_enter/reader_exit; writers replace it with tzfile_publish
+   while holding `tzfile_lock'.  */
+struct tz_zone *tzfile_zone;
+static pthread_mutex_t tzfile_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Registry of zones opened through tz_zone_open, hashed by name.  */
+#define ZONE_TABLE_SIZE 509
+static struct tz_zone *zone_table[ZONE_TABLE_SIZE];
+static pthread_mutex_t zone_table_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* A name in the registry for a zone registered under another name,
+   whose content its file turned out to hold as well.  An alias holds
+   no reference to ZONE: each tz_zone_open through it takes one, and
+   the aliases are dropped with the zone when its last reference goes.
+   The file is kept track of for the watcher; SAVED is what
+   tz_memory_stats counted for the zone loaded from it, which was
+   dropped.  */
+struct tz_alias
+{
+  struct tz_alias *next;	/* Chain in `alias_table'.  */
+  struct tz_alias *zone_next;	/* Next alias of the same zone.  */
+  struct tz_zone *zone;
+  char *name;
+  char *path;
+  dev_t dev;
+  ino_t ino;
+  time_t mtime;
+  size_t saved;
+};
+
+/* Aliases hashed by name, and registered zones by content.  Both are
+   covered by `zone_table_lock'.  */
+static struct tz_alias *alias_table[ZONE_TABLE_SIZE];
+static struct tz_zone *content_table[ZONE_TABLE_SIZE];
+
+static inline int bswap_32(const int i) {
+    printf("Got %.2x %.2x %.2x %.2x\n", ((unsigned char *)&i)[0], ((unsigned char *)&i)[1], ((unsigned char *)&i)[2], ((unsigned char *)&i)[3]);
+
+    int top = (i & (0xff << 0)) << 24;
+    int second = (i & (0xff << 8)) << 16;
+    int third = (i & (0xff << 16)) << 8;
+    int bottom = (i & (0xff << 24)) << 0;
+
+    printf("Top: %x\nSecond: %x\nThird: %x\nBottom: %x\n",top,second,third,bottom);
+    printf("Mixed: %x\n",top|second|third|bottom);
+    return ((i & 0xff) << 24) |
+           ((i & (0xff << 8)) << 16) |
+           ((i & (0xff << 16)) << 8) |
+           ((i & (0xff << 24)));
+
+}
+
+static size_t __tzname_cur_max = 0;
+
+static void
+compute_tzname_max (const struct tz_zone *zone)
+{
+  const char *p;
+
+  p = zone->zone_names;
+  do
+    {
+      const char *start = p;
+      while (*p != '\0')
+	++p;
+      if ((size_t) (p - start) > __tzname_cur_max)
+	__tzname_cur_max = p - start;
+    }
+  while (++p < &zone->zone_names[zone->num_chars]);
+}
+
+/* Return the number of leap second records of ZONE whose transition is
+   at or before TIMER.  */
+static size_t
+zone_leap_search (const struct tz_zone *zone, time_t timer)
+{
+  size_t lo = 0, hi = zone->num_leaps;
+
+  while (lo < hi)
+    {
+      size_t i = (lo + hi) / 2;
+
+      if (zone_leap_transition (zone, i) <= timer)
+	lo = i + 1;
+      else
+	hi = i;
+    }
+  return lo;
+}
+
+/* Return the number of transitions of ZONE at or before TIMER, or
+   before TIMER if STRICT.  */
+static size_t
+zone_transition_count (const struct tz_zone *zone, time_t timer, int strict)
+{
+  size_t lo = 0, hi = zone->num_transitions;
+
+  while (lo < hi)
+    {
+      size_t i = (lo + hi) / 2;
+      time_t t = zone_transition (zone, i);
+
+      if (t < timer || (!strict && t == timer))
+	lo = i + 1;
+      else
+	hi = i;
+    }
+  return lo;
+}
+
+/* As zone_search, for a compact zone: find the block, then search its
+   deltas from the block's base.  */
+static size_t
+compact_search (const struct tz_compact *c, time_t timer)
+{
+  size_t k = c->num_blocks - 1, n;
+  const uint32_t *p;
+  uint64_t span;
+  uint32_t d;
+
+  while (k > 0 && c->base[k] > timer)
+    --k;
+  /* Past the block's span, all of its deltas are smaller.  */
+  span = (uint64_t) timer - (uint64_t) c->base[k];
+  d = span > UINT32_MAX ? UINT32_MAX : (uint32_t) span;
+  p = c->delta + c->block_first[k];
+  n = c->block_first[k + 1] - c->block_first[k];
+  while (n > 0)
+    {
+      size_t half = n / 2;
+
+      if (p[half] <= d)
+	{
+	  p += half + 1;
+	  n -= half + 1;
+	}
+      else
+	n = half;
+    }
+  return p - c->delta;
+}
+
+/* Build the index ZONE wants, unless another thread has done so
+   already, and publish it.  Returns the zone's index, or NULL if it
+   wants none or memory runs out.  */
+static __attribute__ ((noinline)) const struct tz_index *
+zone_index_build (struct tz_zone *zone)
+{
+  struct tz_index *index;
+  size_t n = zone->num_transitions, buckets, b, i;
+  time_t base, last;
+  int shift;
+
+  pthread_mutex_lock (&zone_index_lock);
+  index = zone->index;
+  shift = zone->index_shift;
+  if (index != &index_wanted)
+    goto out;
+  index = NULL;
+  if (n < 2)
+    goto out;
+
+  last = zone_transition (zone, n - 1);
+  for (i = 0; (((uint64_t) last - (uint64_t) zone_transition (zone, i))
+	       >> shift) >= INDEX_MAX_BUCKETS; ++i)
+    continue;
+  base = zone_transition (zone, i);
+  buckets = (((uint64_t) last - (uint64_t) base) >> shift) + 1;
+
+  index = malloc (sizeof (struct tz_index)
+		  + buckets * sizeof (struct tz_index_bucket));
+  if (index == NULL)
+    goto out;
+  index->prev = NULL;
+  index->base = base;
+  index->shift = shift;
+  index->num_buckets = buckets;
+  for (b = 0; b < buckets; ++b)
+    {
+      time_t start = base + (time_t) ((uint64_t) b << shift);
+      uint64_t next;
+
+      while (i < n && zone_transition (zone, i) <= start)
+	++i;
+      /* Only the last bucket can start at the last transition, and no
+	 lookup uses it.  */
+      next = i < n ? (uint64_t) zone_transition (zone, i) - start : 0;
+      index->bucket[b].first = i;
+      index->bucket[b].next = next > UINT32_MAX ? UINT32_MAX : next;
+    }
+  __atomic_store_n (&zone->index, index, __ATOMIC_RELEASE);
+
+ out:
+  pthread_mutex_unlock (&zone_index_lock);
+  return index;
+}
+
+/* As zone_search, with the direct index INDEX, for TIMER not before
+   its base: one load, and a comparison with the first transition of
+   the bucket; only if the bucket holds more than one transition does
+   it go on to decode the next ones.  */
+static inline size_t
+index_search (const struct tz_zone *zone, const struct tz_index *index,
+	      time_t timer)
+{
+  uint64_t off = (uint64_t) timer - (uint64_t) index->base;
+  const struct tz_index_bucket *b = &index->bucket[off >> index->shift];
+  size_t i = b->first;
+
+  if (__builtin_expect ((off & ((UINT64_C (1) << index->shift) - 1))
+			>= b->next, 0))
+    while (zone_transition (zone, i) <= timer)
+      ++i;
+  return i;
+}
+
+/* Return the index of the first transition of ZONE after TIMER.  TIMER
+   must not be before the first transition or after the last one.  The
+   direct index is used if the zone has one; otherwise the descent has
+   no data-dependent branches, and prefetches the slots three levels
+   down while the current level is compared.  */
+static inline size_t
+zone_search (const struct tz_zone *zone, time_t timer)
+{
+  const struct tz_index *index;
+  const time_t *eytz = zone->eytz;
+  size_t n = zone->num_transitions;
+  size_t k = 1;
+
+  index = __atomic_load_n (&zone->index, __ATOMIC_ACQUIRE);
+  if (index != NULL)
+    {
+      if (__builtin_expect (index == &index_wanted, 0))
+	index = zone_index_build ((struct tz_zone *) zone);
+      if (index != NULL && timer >= index->base)
+	{
+	  TZ_COUNT (zone, search_index);
+	  return index_search (zone, index, timer);
+	}
+    }
+
+  if (__builtin_expect (zone->compact != NULL, 0))
+    return compact_search (zone->compact, timer);
+
+  while (k <= n)
+    {
+      __builtin_prefetch (eytz + 8 * k);
+      k = 2 * k + (eytz[k] <= timer);
+    }
+  /* Strip the trailing right turns and the last left turn to get the
+     slot of the smallest time greater than TIMER.  */
+  k >>= __builtin_ffsl (~(long) k);
+  return zone->eytz_pos[k];
+}
+
+size_t
+__tzfile_search (const struct tz_zone *zone, time_t timer)
+{
+  return zone_search (zone, timer);
+}
+
+/* Fill the subtree of the Eytzinger layout rooted at slot K with the
+   transitions of ZONE starting at index I.  Returns the index of the
+   first transition not used.  */
+static size_t
+eytzinger_fill (struct tz_zone *zone, size_t i, size_t k)
+{
+  if (k <= zone->num_transitions)
+    {
+      i = eytzinger_fill (zone, i, 2 * k);
+      zone->eytz[k] = zone_transition (zone, i);
+      zone->eytz_pos[k] = i++;
+      i = eytzinger_fill (zone, i, 2 * k + 1);
+    }
+  return i;
+}
+
+
+/* Return the directory relative zone names are looked up in.  */
+const char *
+tzfile_dir (void)
+{
+  const char *tzdir = getenv ("TZDIR");
+
+  return tzdir == NULL || *tzdir == '\0' ? TZDIR : tzdir;
+}
+
+/* Return the full path of the zone file for FILE, or NULL if FILE may
+   not be read.  The result is allocated with malloc.  */
+static char *
+tzfile_path (const char *file)
+{
+  static const char default_tzdir[] = TZDIR;
+
+  if (file == NULL)
+    /* No user specification; use the site-wide default.  */
+    file = TZDEFAULT;
+  else if (*file == '\0')
+    /* User specified the empty string; use UTC with no leap seconds.  */
+    return NULL;
+  else
+    {
+      /* We must not allow to read an arbitrary file in a setuid
+	 program.  So we fail for any file which is not in the
+	 directory hierachy starting at TZDIR
+	 and which is not the system wide default TZDEFAULT.  */
+      if (1
+	  && ((*file == '/'
+	       && memcmp (file, TZDEFAULT, sizeof TZDEFAULT)
+	       && memcmp (file, default_tzdir, sizeof (default_tzdir) - 1))
+	      || strstr (file, "../") != NULL))
+	/* This test is certainly a bit too restrictive but it should
+	   catch all critical cases.  */
+	return NULL;
+    }
+
+  if (*file != '/')
+    {
+      const char *tzdir;
+      unsigned int len, tzdir_len;
+      char *new, *tmp;
+
+      tzdir = tzfile_dir ();
+      tzdir_len = strlen (tzdir);
+      len = strlen (file) + 1;
+      new = (char *) malloc(tzdir_len + 1 + len);
+      if (new == NULL)
+	return NULL;
+      tmp = (char *)__mempcpy (new, tzdir, tzdir_len);
+      *tmp++ = '/';
+      memcpy (tmp, file, len);
+      return new;
+    }
+
+  return strdup (file);
+}
+
+/* POSIX TZ rules.  The TZ string at the end of a version 2+ file says
+   how to compute offsets after the last transition.  It is compiled
+   once when the zone is loaded, and the change instants are worked out
+   a year at a time and kept.  */
+
+#define TIME_T_MIN \
+  (sizeof (time_t) == 8 ? (time_t) INT64_MIN : (time_t) INT32_MIN)
+#define TIME_T_MAX \
+  (sizeof (time_t) == 8 ? (time_t) INT64_MAX : (time_t) INT32_MAX)
+
+static const unsigned short int mon_yday[2][13] =
+  {
+    /* Normal years.  */
+    { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334, 365 },
+    /* Leap years.  */
+    { 0, 31, 60, 91, 121, 152, 182, 213, 244, 274, 305, 335, 366 }
+  };
+
+/* Rule years are kept well inside the range where the arithmetic
+   below cannot overflow.  */
+#define RULE_YEAR_LIMIT (1 << 30)
+
+/* Most years a rule table may grow to cover.  Lookups further away
+   are worked out each time.  */
+#define RULE_YEARS_MAX 1024
+
+/* Change instants of a range of years.  */
+struct tz_rule_years
+{
+  struct tz_rule_years *prev;	/* Superseded table.  */
+  int first;			/* First year covered.  */
+  int count;			/* Number of years covered.  */
+  time_t end;			/* Start of the year after the last.  */
+  /* For each year: the start of the year, the start of daylight time
+     and the end of daylight time, all in UTC.  */
+  time_t (*change)[3];
+};
+
+/* Return the UTC instant at which RULE takes effect in YEAR, where
+   OFFSET is the offset in force just before it.  */
+static time_t
+rule_change (const struct tz_rule *rule, int year, long int offset)
+{
+  time_t t = year_start (year);
+
+  switch (rule->type)
+    {
+    case J1:
+      /* Jn - Julian day, 1 == January 1, 60 == March 1 even in leap
+	 years.  */
+      t += (time_t) (rule->d - 1) * SECSPERDAY;
+      if (rule->d >= 60 && isleap (year))
+	t += SECSPERDAY;
+      break;
+
+    case J0:
+      /* n - Day of year.  */
+      t += (time_t) rule->d * SECSPERDAY;
+      break;
+
+    case M:
+      /* Mm.n.d - Nth "Dth day" of month M.  */
+      {
+	const unsigned short int *myday = &mon_yday[isleap (year)][rule->m];
+	long long int days = days_from_civil (year, rule->m, 1);
+	unsigned int i;
+	int d, dow;
+
+	/* DOW is the day-of-week of the first day of month M.  Get the
+	   day-of-month (zero-origin) of the first DOW day of the
+	   month.  */
+	dow = (int) ((days % DAYSPERWEEK + EPOCH_WDAY + DAYSPERWEEK)
+		     % DAYSPERWEEK);
+	d = rule->d - dow;
+	if (d < 0)
+	  d += DAYSPERWEEK;
+	for (i = 1; i < rule->n; ++i)
+	  {
+	    if (d + DAYSPERWEEK >= (int) myday[0] - myday[-1])
+	      break;
+	    d += DAYSPERWEEK;
+	  }
+	t = (time_t) (days + d) * SECSPERDAY;
+      }
+      break;
+    }
+
+  return t - offset + rule->secs;
+}
+
+/* Return the year TIMER falls in, in UTC.  TIMER must be within
+   RULE_YEAR_LIMIT years of the epoch.  */
+static int
+rules_year (time_t timer)
+{
+  /* 31556952 is the average length of a Gregorian year.  */
+  long long int y = EPOCH_YEAR + timer / 31556952;
+
+  if (timer < 0 && timer % 31556952 != 0)
+    --y;
+  while (year_start (y) > timer)
+    --y;
+  while (year_start (y + 1) <= timer)
+    ++y;
+  return y;
+}
+
+/* Work out the change instants of RULES for the years of YEARS.  */
+static void
+rules_fill (const struct tz_rules *rules, struct tz_rule_years *years)
+{
+  int i;
+
+  years->end = year_start (years->first + years->count);
+  for (i = 0; i < years->count; ++i)
+    {
+      int year = years->first + i;
+
+      years->change[i][0] = year_start (year);
+      years->change[i][1] = rule_change (&rules->rule[0], year,
+					 rules->offset[0]);
+      years->change[i][2] = rule_change (&rules->rule[1], year,
+					 rules->offset[1]);
+    }
+}
+
+/* Return a rule table of RULES covering the year of TIMER.  If the
+   current table does not, it is widened; but a year too far from it
+   is worked out into SCRATCH, which must have room for one year,
+   rather than kept.  Returns NULL if TIMER is out of range or memory
+   runs out.  */
+static const struct tz_rule_years *
+rules_years (struct tz_rules *rules, time_t timer,
+	     struct tz_rule_years *scratch)
+{
+  const struct tz_rule_years *years;
+  struct tz_rule_years *old, *new;
+  int year, first, last;
+
+  years = __atomic_load_n (&rules->years, __ATOMIC_ACQUIRE);
+  if (years != NULL && timer >= years->change[0][0] && timer < years->end)
+    return years;
+
+  if (timer / 31556952 >= RULE_YEAR_LIMIT
+      || timer / 31556952 <= -RULE_YEAR_LIMIT)
+    return NULL;
+  year = rules_year (timer);
+
+  pthread_mutex_lock (&rules->lock);
+  old = rules->years;
+  if (old != NULL && timer >= old->change[0][0] && timer < old->end)
+    {
+      /* Somebody else got there first.  */
+      pthread_mutex_unlock (&rules->lock);
+      return old;
+    }
+
+  /* Widen the current table towards YEAR, with some room to spare, as
+     lookups tend to move steadily in one direction.  */
+  first = year;
+  last = year + 15;
+  if (old != NULL)
+    {
+      if (year < old->first)
+	{
+	  first = year - 15;
+	  last = old->first + old->count - 1;
+	}
+      else
+	first = old->first;
+    }
+  if (last - first + 1 > RULE_YEARS_MAX)
+    {
+      pthread_mutex_unlock (&rules->lock);
+      scratch->first = year;
+      scratch->count = 1;
+      rules_fill (rules, scratch);
+      return scratch;
+    }
+
+  new = malloc (sizeof (struct tz_rule_years)
+		+ (last - first + 1) * sizeof (new->change[0]));
+  if (new == NULL)
+    {
+      pthread_mutex_unlock (&rules->lock);
+      return NULL;
+    }
+  new->prev = old;
+  new->first = first;
+  new->count = last - first + 1;
+  new->change = (time_t (*)[3]) (new + 1);
+  rules_fill (rules, new);
+
+  __atomic_store_n (&rules->years, new, __ATOMIC_RELEASE);
+  pthread_mutex_unlock (&rules->lock);
+  return new;
+}
+
+/* Return whether daylight time is in effect at TIMER under RULES, and
+   store the first and last instants for which that stays the same in
+   *LO and *HI.  Returns -1 if TIMER is out of range.  */
+static int
+rules_interval (struct tz_rules *rules, time_t timer, time_t *lo, time_t *hi)
+{
+  const struct tz_rule_years *years;
+  struct tz_rule_years scratch;
+  time_t scratch_change[1][3];
+  time_t start, end;
+  size_t l, h;
+  int isdst;
+
+  if (!rules->has_dst)
+    {
+      *lo = TIME_T_MIN;
+      *hi = TIME_T_MAX;
+      return 0;
+    }
+
+  scratch.change = scratch_change;
+  years = rules_years (rules, timer, &scratch);
+  if (years == NULL)
+    return -1;
+
+  /* Find the year.  */
+  l = 0;
+  h = years->count;
+  while (l + 1 < h)
+    {
+      size_t i = (l + h) / 2;
+
+      if (timer < years->change[i][0])
+	h = i;
+      else
+	l = i;
+    }
+  start = years->change[l][1];
+  end = years->change[l][2];
+
+  /* We have to distinguish between northern and southern hemisphere.
+     For the latter the daylight saving time ends in the next year.  */
+  if (__builtin_expect (start > end, 0))
+    isdst = timer < end || timer >= start;
+  else
+    isdst = timer >= start && timer < end;
+
+  /* The answer is decided within the year by which side of START and
+     END TIMER is on.  */
+  *lo = years->change[l][0];
+  *hi = (l + 1 < (size_t) years->count
+	 ? years->change[l + 1][0] : years->end) - 1;
+  if (start <= timer && start > *lo)
+    *lo = start;
+  if (end <= timer && end > *lo)
+    *lo = end;
+  if (start > timer && start - 1 < *hi)
+    *hi = start - 1;
+  if (end > timer && end - 1 < *hi)
+    *hi = end - 1;
+  return isdst;
+}
+
+static void
+rules_free (struct tz_rules *rules)
+{
+  struct tz_rule_years *years, *prev;
+
+  if (rules == NULL)
+    return;
+  for (years = rules->years; years != NULL; years = prev)
+    {
+      prev = years->prev;
+      free (years);
+    }
+  pthread_mutex_destroy (&rules->lock);
+  free (rules);
+}
+
+/* Parse a zone name at P into *NAME.  Returns a pointer past it, or
+   NULL if there is none.  */
+static const char *
+rules_parse_name (struct tz_strtab *strings, const char *p, char **name)
+{
+  const char *start, *end;
+  char buf[TZ_MAX_CHARS + 1];
+
+  if (*p == '<')
+    {
+      /* Quoted form: <[+-]?[A-Za-z0-9]+>.  */
+      start = ++p;
+      while (isalnum ((unsigned char) *p) || *p == '+' || *p == '-')
+	++p;
+      if (*p != '>')
+	return NULL;
+      end = p++;
+    }
+  else
+    {
+      start = p;
+      while (isalpha ((unsigned char) *p))
+	++p;
+      end = p;
+    }
+  if (end - start < 3 || end - start > TZ_MAX_CHARS)
+    return NULL;
+
+  memcpy (buf, start, end - start);
+  buf[end - start] = '\0';
+  *name = tz_intern (strings, buf);
+  return *name == NULL ? NULL : p;
+}
+
+/* Parse [+-]hh[:mm[:ss]] at P into *SECS, allowing up to MAX_HOURS.
+   Returns a pointer past it, or NULL if it is malformed.  */
+static const char *
+rules_parse_hms (const char *p, int max_hours, long int *secs)
+{
+  int sign = 1;
+  long int hh, mm = 0, ss = 0;
+  char *end;
+
+  if (*p == '-' || *p == '+')
+    sign = *p++ == '-' ? -1 : 1;
+  if (!isdigit ((unsigned char) *p))
+    return NULL;
+  hh = strtol (p, &end, 10);
+  p = end;
+  if (*p == ':')
+    {
+      if (!isdigit ((unsigned char) *++p))
+	return NULL;
+      mm = strtol (p, &end, 10);
+      p = end;
+      if (*p == ':')
+	{
+	  if (!isdigit ((unsigned char) *++p))
+	    return NULL;
+	  ss = strtol (p, &end, 10);
+	  p = end;
+	}
+    }
+  if (hh > max_hours || mm >= MINSPERHOUR || ss >= SECSPERMIN)
+    return NULL;
+  *secs = sign * (hh * SECSPERHOUR + mm * SECSPERMIN + ss);
+  return p;
+}
+
+/* Parse ,date[/time] at P into *RULE.  Returns a pointer past it, or
+   NULL if it is malformed.  */
+static const char *
+rules_parse_rule (const char *p, struct tz_rule *rule)
+{
+  long int secs;
+  char *end;
+
+  if (*p++ != ',')
+    return NULL;
+  if (*p == 'J' || isdigit ((unsigned char) *p))
+    {
+      rule->type = *p == 'J' ? J1 : J0;
+      if (rule->type == J1)
+	++p;
+      if (!isdigit ((unsigned char) *p))
+	return NULL;
+      rule->d = strtoul (p, &end, 10);
+      p = end;
+      if (rule->type == J1 ? rule->d < 1 || rule->d > 365 : rule->d > 365)
+	return NULL;
+    }
+  else if (*p == 'M')
+    {
+      rule->type = M;
+      rule->m = strtoul (p + 1, &end, 10);
+      if (end == p + 1 || *end != '.')
+	return NULL;
+      p = end + 1;
+      rule->n = strtoul (p, &end, 10);
+      if (end == p || *end != '.')
+	return NULL;
+      p = end + 1;
+      rule->d = strtoul (p, &end, 10);
+      if (end == p)
+	return NULL;
+      p = end;
+      if (rule->m < 1 || rule->m > 12 || rule->n < 1 || rule->n > 5
+	  || rule->d > 6)
+	return NULL;
+    }
+  else
+    return NULL;
+
+  /* The time of day defaults to 2:00; RFC 8536 allows -167 to 167
+     hours.  */
+  secs = 2 * SECSPERHOUR;
+  if (*p == '/' && (p = rules_parse_hms (p + 1, 167, &secs)) == NULL)
+    return NULL;
+  rule->secs = secs;
+  return p;
+}
+
+/* Compile the POSIX TZ string SPEC.  Returns NULL if it is malformed
+   or memory runs out.  */
+static struct tz_rules *
+rules_compile (struct tz_strtab *strings, const char *spec)
+{
+  struct tz_rules *rules;
+  const char *p = spec;
+  long int secs;
+
+  rules = calloc (1, sizeof (struct tz_rules));
+  if (rules == NULL)
+    return NULL;
+  pthread_mutex_init (&rules->lock, NULL);
+
+  /* POSIX offsets are west of UTC.  */
+  p = rules_parse_name (strings, p, &rules->name[0]);
+  if (p == NULL || (p = rules_parse_hms (p, 24, &secs)) == NULL)
+    goto lose;
+  rules->offset[0] = -secs;
+
+  if (*p == '\0')
+    {
+      rules->name[1] = rules->name[0];
+      rules->offset[1] = rules->offset[0];
+      return rules;
+    }
+
+  p = rules_parse_name (strings, p, &rules->name[1]);
+  if (p == NULL)
+    goto lose;
+  rules->has_dst = 1;
+  rules->offset[1] = rules->offset[0] + SECSPERHOUR;
+  if (*p != ',' && *p != '\0')
+    {
+      if ((p = rules_parse_hms (p, 24, &secs)) == NULL)
+	goto lose;
+      rules->offset[1] = -secs;
+    }
+
+  if (*p == '\0')
+    {
+      /* No rules given; use the US ones, as the POSIX default.  */
+      p = ",M3.2.0,M11.1.0";
+    }
+  if ((p = rules_parse_rule (p, &rules->rule[0])) == NULL
+      || (p = rules_parse_rule (p, &rules->rule[1])) == NULL
+      || *p != '\0')
+    goto lose;
+  return rules;
+
+ lose:
+  rules_free (rules);
+  return NULL;
+}
+
+/* Work out the names __tzfile_compute reports for each transition
+   slot of ZONE, as indices into its names, and store them in ABBRS.
+   These depend only on the slot, so doing it here keeps the name
+   searches out of the lookup path.  */
+static void
+zone_slot_abbrs (const struct tz_zone *zone, unsigned char (*abbrs)[2])
+{
+  size_t n = zone->num_transitions;
+  int next[2] = { -1, -1 };
+  size_t i;
+
+  /* Before any transition (or if there are none) the name of the type
+     used then and of the first DST type.  */
+  abbrs[0][0] = abbrs[0][1] = zone_type_idx (zone, zone->before_type);
+  for (i = 0; i < zone->num_types; ++i)
+    if (zone_type_isdst (zone, i))
+      {
+	abbrs[0][1] = zone_type_idx (zone, i);
+	break;
+      }
+
+  /* After a transition, the name of its own type, and for the other
+     flavor the first name of that flavor from the transition on, or
+     its own if there is none.  Walk backwards, keeping the nearest
+     later name of each flavor.  */
+  for (i = n; i > 0; --i)
+    {
+      int type = zone->type_idxs[i - 1];
+      int dst = zone_type_isdst (zone, type);
+      int idx = zone_type_idx (zone, type);
+
+      abbrs[i][dst] = idx;
+      abbrs[i][1 - dst] = next[1 - dst] >= 0 ? next[1 - dst] : idx;
+      next[dst] = idx;
+    }
+}
+
+/* Intern the names of each transition slot of ZONE in TZNAMES.  */
+static int
+zone_build_tznames (struct tz_zone *zone)
+{
+  size_t n = zone->num_transitions;
+  unsigned char (*abbrs)[2];
+  char *names[256];
+  size_t i;
+  int j;
+
+  zone->tznames = malloc ((n + 1) * sizeof (*zone->tznames));
+  abbrs = malloc ((n + 1) * sizeof (*abbrs));
+  if (zone->tznames == NULL || abbrs == NULL)
+    {
+      free (abbrs);
+      return -1;
+    }
+  zone_slot_abbrs (zone, abbrs);
+
+  /* Each name is interned once.  */
+  memset (names, 0, sizeof names);
+  for (i = 0; i <= n; ++i)
+    for (j = 0; j < 2; ++j)
+      {
+	if (names[abbrs[i][j]] == NULL)
+	  names[abbrs[i][j]] = tz_intern (zone->strings,
+					  &zone->zone_names[abbrs[i][j]]);
+	zone->tznames[i][j] = names[abbrs[i][j]];
+      }
+  free (abbrs);
+  return 0;
+}
+
+/* Return the standard (DST zero) or daylight name of transition slot I
+   of ZONE.  */
+static inline char *
+zone_slot_name (const struct tz_zone *zone, size_t i, int dst)
+{
+  if (__builtin_expect (zone->compact != NULL, 0))
+    return (char *) &zone->zone_names[zone->compact->slot_abbrs[i][dst]];
+  return zone->tznames[i][dst];
+}
+
+/* Decode the counts in the header at P, which is followed by a data
+   block using TRANS_WIDTH-byte times.  Returns the size of that block,
+   or 0 if the header is bad or the block does not end before END.  */
+static size_t
+tzfile_counts (const unsigned char *p, const unsigned char *end,
+	       int trans_width, size_t counts[6])
+{
+  const struct tzhead *tzhead = (const struct tzhead *) p;
+  uint64_t size;
+  int i;
+
+  if ((size_t) (end - p) < sizeof (struct tzhead)
+      || memcmp (tzhead->tzh_magic, TZ_MAGIC, sizeof (tzhead->tzh_magic)) != 0)
+    return 0;
+
+  counts[0] = decode (tzhead->tzh_timecnt);
+  counts[1] = decode (tzhead->tzh_typecnt);
+  counts[2] = decode (tzhead->tzh_charcnt);
+  counts[3] = decode (tzhead->tzh_leapcnt);
+  counts[4] = decode (tzhead->tzh_ttisstdcnt);
+  counts[5] = decode (tzhead->tzh_ttisgmtcnt);
+  for (i = 0; i < 6; ++i)
+    if (counts[i] > INT_MAX)
+      return 0;
+
+  size = ((uint64_t) counts[0] * (trans_width + 1)
+	  + (uint64_t) counts[1] * 6
+	  + counts[2]
+	  + (uint64_t) counts[3] * (trans_width + 4)
+	  + counts[4]
+	  + counts[5]);
+  if (size == 0 || size > (uint64_t) (end - p) - sizeof (struct tzhead))
+    return 0;
+  return size;
+}
+
+/* Narrow the transitions of ZONE to those lookups in WINDOW need: from
+   the last one at or before its start, which says what the window
+   starts in, through the first one at or after its end, so that no
+   instant in the window is taken to be past the last transition unless
+   it was before.  Only the coded times the binary searches touch are
+   read.  */
+static void
+zone_narrow (struct tz_zone *zone, const struct tz_window *window)
+{
+  size_t first, last;
+
+  first = zone_transition_count (zone, window->from, 0);
+  if (first > 0)
+    --first;
+  last = zone_transition_count (zone, window->to, 1);
+  if (last < zone->num_transitions)
+    ++last;
+
+  zone->transitions += first * zone->trans_width;
+  zone->type_idxs += first;
+  zone->num_transitions = last - first;
+  zone->windowed = 1;
+  zone->window_from = window->from;
+  zone->window_to = window->to;
+}
+
+/* Check for bogus values in the tables of ZONE, so we can hereafter
+   safely use type_idxs[T] as indices into `types', and the name
+   indices of the types as indices into `zone_names', and never
+   crash.  Returns 0 if they are sound.  */
+static int
+zone_check (const struct tz_zone *zone)
+{
+  size_t i;
+
+  if (zone->num_types == 0
+      || zone->num_chars == 0
+      || zone->zone_names[zone->num_chars - 1] != '\0'
+      || zone->num_isstd > zone->num_types
+      || zone->num_isgmt > zone->num_types)
+    return -1;
+  for (i = 0; i < zone->num_transitions; ++i)
+    if (__builtin_expect (zone->type_idxs[i] >= zone->num_types, 0))
+      return -1;
+  for (i = 0; i < zone->num_types; ++i)
+    if (__builtin_expect (zone->types[i * 6 + 4] > 1, 0)
+	|| __builtin_expect (zone->types[i * 6 + 5] >= zone->num_chars, 0))
+      return -1;
+  return 0;
+}
+
+/* Build everything ZONE derives from its checked tables: the compiled
+   TZ rules, the search layout, the names for each transition and the
+   offsets for the legacy globals.  Returns 0 on success.  */
+static int
+zone_setup (struct tz_zone *zone)
+{
+  size_t i;
+
+  if (zone->tzspec != NULL)
+    /* A TZ string we cannot use is ignored, as if it were absent.  */
+    zone->rules = rules_compile (zone->strings, zone->tzspec);
+
+  /* Before any transition (or if there are none) the first non-DST
+     type is used, or the first if they're all DST types.  */
+  for (i = 0; i < zone->num_types && zone_type_isdst (zone, i); ++i)
+    continue;
+  zone->before_type = i == zone->num_types ? 0 : i;
+
+  /* A compact zone keeps just the name indices of each slot, and
+     searches its own tables.  */
+  if (zone->compact != NULL)
+    zone_slot_abbrs (zone, zone->compact->slot_abbrs);
+  else if (zone_build_tznames (zone) != 0)
+    return -1;
+
+  /* Build the search layout.  */
+  if (zone->compact == NULL && zone->num_transitions > 0)
+    {
+      size_t n = zone->num_transitions + 1;
+      size_t bytes = n * sizeof (time_t) + n * sizeof (uint32_t);
+
+      zone->eytz = aligned_alloc (64, (bytes + 63) & ~(size_t) 63);
+      if (zone->eytz == NULL)
+	return -1;
+      zone->eytz_pos = (uint32_t *) (zone->eytz + n);
+      eytzinger_fill (zone, 0, 1);
+    }
+
+  /* Local times can only map to instants this far away.  */
+  zone->max_offset = 0;
+  for (i = 0; i < zone->num_types; ++i)
+    if (labs (zone_type_offset (zone, i)) > zone->max_offset)
+      zone->max_offset = labs (zone_type_offset (zone, i));
+  if (zone->rules != NULL)
+    for (i = 0; i < 2; ++i)
+      if (labs (zone->rules->offset[i]) > zone->max_offset)
+	zone->max_offset = labs (zone->rules->offset[i]);
+
+  /* First "register" all timezone names.  */
+  for (i = 0; i < zone->num_types; ++i)
+    (void) tz_intern (zone->strings,
+		      &zone->zone_names[zone_type_idx (zone, i)]);
+
+  /* Find the standard and daylight time offsets used by the rule file.
+     We choose the offsets in the types of each flavor that are
+     transitioned to earliest in time.  */
+  zone->tzname[0] = NULL;
+  zone->tzname[1] = NULL;
+  for (i = zone->num_transitions; i > 0; )
+    {
+      int type = zone->type_idxs[--i];
+      int dst = zone_type_isdst (zone, type);
+
+      if (zone->tzname[dst] == NULL)
+	{
+	  int idx = zone_type_idx (zone, type);
+
+	  zone->tzname[dst] = tz_intern (zone->strings,
+					 &zone->zone_names[idx]);
+
+	  if (zone->tzname[1 - dst] != NULL)
+	    break;
+	}
+    }
+  if (zone->tzname[0] == NULL)
+    /* No transition is to standard time.  Usually there are none at
+       all and only one type, but a file cut down to a window may start
+       in standard time and only go to daylight time; either way, use
+       what applies before the first transition.  */
+    zone->tzname[0]
+      = tz_intern (zone->strings,
+		   &zone->zone_names[zone_type_idx (zone,
+						    zone->before_type)]);
+  if (zone->tzname[1] == NULL)
+    zone->tzname[1] = zone->tzname[0];
+
+  if (zone->num_transitions == 0)
+    /* Use the first rule (which should also be the only one).  */
+    zone->rule_stdoff = zone->rule_dstoff = zone_type_offset (zone, 0);
+  else
+    {
+      int stdoff_set = 0, dstoff_set = 0;
+      zone->rule_stdoff = zone->rule_dstoff = 0;
+      i = zone->num_transitions - 1;
+      do
+	{
+	  int type = zone->type_idxs[i];
+
+	  if (!stdoff_set && !zone_type_isdst (zone, type))
+	    {
+	      stdoff_set = 1;
+	      zone->rule_stdoff = zone_type_offset (zone, type);
+	    }
+	  else if (!dstoff_set && zone_type_isdst (zone, type))
+	    {
+	      dstoff_set = 1;
+	      zone->rule_dstoff = zone_type_offset (zone, type);
+	    }
+	  if (stdoff_set && dstoff_set)
+	    break;
+	}
+      while (i-- > 0);
+
+      if (!dstoff_set)
+	zone->rule_dstoff = zone->rule_stdoff;
+    }
+
+  return 0;
+}
+
+static void
+zone_index_free (struct tz_index *index)
+{
+  struct tz_index *prev;
+
+  for (; index != NULL; index = prev)
+    {
+      prev = index->prev;
+      free (index);
+    }
+}
+
+static void
+zone_free_tables (struct tz_zone *zone)
+{
+  free (zone->eytz);
+  free (zone->tznames);
+  free (zone->compact);
+  if (zone->index != &index_wanted)
+    zone_index_free (zone->index);
+  zone_index_free (zone->index_old);
+  rules_free (zone->rules);
+  strtab_free (zone->strings);
+  free (zone->path);
+}
+
+void
+tzfile_free (struct tz_zone *zone)
+{
+  if (zone == NULL)
+    return;
+  if (zone->map_heap)
+    free (zone->map);
+  else if (zone->map != NULL)
+    munmap (zone->map, zone->map_size);
+  else if (zone->db != NULL)
+    tz_db_close (zone->db);
+  zone_free_tables (zone);
+  free (zone->name);
+  free (zone);
+}
+
+/* Make a new, unregistered zone from the SIZE bytes of TZif data at
+   MAP, which must stay in place for as long as the zone exists.  The
+   data is validated once here; afterwards its tables are used in place
+   through the zone_* accessors.  EXTRA writable bytes are allocated
+   with the zone and returned in *EXTRAP.  If PRIVATE_STRINGS, the
+   zone's strings go in a table of its own, freed with it; otherwise
+   they are given to __tzstring, as __tzname needs for the process
+   zone.  If WINDOW is not NULL, only the transitions lookups in it need
+   are used, and the zone answers no others.  Returns NULL if the data
+   is malformed; MAP is then left to the caller.  */
+struct tz_zone *
+tzfile_parse (const void *map, size_t map_size, size_t extra, char **extrap,
+	      int private_strings, const struct tz_window *window)
+{
+  struct tz_zone *zone;
+  const unsigned char *p, *end;
+  size_t counts[6];
+  size_t size;
+  int trans_width = 4;
+
+  if (map_size < sizeof (struct tzhead))
+    return NULL;
+
+  zone = (struct tz_zone *) calloc (1, sizeof (struct tz_zone) + extra);
+  if (zone == NULL)
+    return NULL;
+  zone->map = (void *) map;
+  zone->map_size = map_size;
+  /* Without a table of its own the zone falls back to __tzstring.  */
+  if (private_strings)
+    zone->strings = strtab_new ();
+  if (extra > 0)
+    *extrap = zone->extra = (char *) (zone + 1);
+
+  p = map;
+  end = p + map_size;
+  size = tzfile_counts (p, end, 4, counts);
+  if (size == 0)
+    goto lose;
+
+  /* For platforms with 64-bit time_t we use the new format if available.  */
+  if (sizeof (time_t) == 8
+      && ((const struct tzhead *) p)->tzh_version[0] != '\0')
+    {
+      /* We use the 8-byte format.  */
+      trans_width = 8;
+      p += sizeof (struct tzhead) + size;
+      size = tzfile_counts (p, end, 8, counts);
+      if (size == 0)
+	goto lose;
+    }
+
+  zone->trans_width = trans_width;
+  zone->num_transitions = counts[0];
+  zone->num_types = counts[1];
+  zone->num_chars = counts[2];
+  zone->num_leaps = counts[3];
+  zone->num_isstd = counts[4];
+  zone->num_isgmt = counts[5];
+
+  p += sizeof (struct tzhead);
+  zone->transitions = p;
+  p += zone->num_transitions * trans_width;
+  zone->type_idxs = p;
+  p += zone->num_transitions;
+  zone->types = p;
+  p += zone->num_types * 6;
+  zone->zone_names = (const char *) p;
+  p += zone->num_chars;
+  zone->leaps = p;
+  p += zone->num_leaps * (trans_width + 4);
+  zone->isstd = p;
+  p += zone->num_isstd;
+  zone->isgmt = p;
+  p += zone->num_isgmt;
+
+  if (window != NULL)
+    zone_narrow (zone, window);
+  if (zone_check (zone) != 0)
+    goto lose;
+
+  /* Read the POSIX TZ-style information if possible.  With 4-byte
+     time_t it follows the 64-bit data, which we skip.  */
+  if (sizeof (time_t) == 4
+      && ((const struct tzhead *) map)->tzh_version[0] != '\0')
+    {
+      size = tzfile_counts (p, end, 8, counts);
+      p = size == 0 ? end : p + sizeof (struct tzhead) + size;
+    }
+  if (p < end && *p == '\n')
+    {
+      const unsigned char *nl = memchr (p + 1, '\n', end - (p + 1));
+
+      if (nl != NULL && nl > p + 1)
+	{
+	  char *tzstr = alloca (nl - p);
+
+	  memcpy (tzstr, p + 1, nl - (p + 1));
+	  tzstr[nl - (p + 1)] = '\0';
+	  zone->tzspec = tz_intern (zone->strings, tzstr);
+	}
+    }
+  zone->refcount = 1;
+
+  if (zone_setup (zone) != 0)
+    goto lose;
+
+  return zone;
+
+ lose:
+  zone_free_tables (zone);
+  free (zone);
+  return NULL;
+}
+
+/* Map the zone file at PATH into a new, unregistered zone, as
+   tzfile_parse.  Returns NULL if the file cannot be read or is
+   malformed.  */
+struct tz_zone *
+tzfile_load (const char *path, size_t extra, char **extrap,
+	     int private_strings, const struct tz_window *window)
+{
+  struct stat st;
+  struct tz_zone *zone;
+  int fd, cancel;
+  void *map;
+
+  /* open and close are cancellation points.  Cancellation is disabled
+     while the file is open, as fopen's "c" flag did for glibc, so that
+     a cancelled thread leaves neither the descriptor nor a lock its
+     caller holds behind.  */
+  pthread_setcancelstate (PTHREAD_CANCEL_DISABLE, &cancel);
+  fd = open (path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    {
+      pthread_setcancelstate (cancel, NULL);
+      return NULL;
+    }
+
+  /* Get information about the file we are actually using.  */
+  if (fstat (fd, &st) != 0 || st.st_size < (off_t) sizeof (struct tzhead))
+    map = MAP_FAILED;
+  else
+    map = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  pthread_setcancelstate (cancel, NULL);
+  if (map == MAP_FAILED)
+    return NULL;
+
+  zone = tzfile_parse (map, st.st_size, extra, extrap, private_strings,
+		       window);
+  if (zone == NULL)
+    {
+      munmap (map, st.st_size);
+      return NULL;
+    }
+  zone->path = strdup (path);
+  if (zone->path == NULL)
+    {
+      tzfile_free (zone);
+      return NULL;
+    }
+  zone->dev = st.st_dev;
+  zone->ino = st.st_ino;
+  zone->mtime = st.st_mtime;
+  TZ_COUNT_PROCESS (load);
+  TZ_PROBE (load, zone->path, zone, zone->num_transitions);
+  return zone;
+}
+
+
+/* Readers of `tzfile_zone' never take a lock.  Each thread has a
+   record in `tz_readers' holding the epoch it entered at, or 0 while
+   it is outside __tzfile_compute.  A writer swaps the pointer, moves
+   to a new epoch and waits for every reader still in an older one to
+   leave before freeing what it replaced.  */
+struct tz_reader
+{
+  struct tz_reader *next;
+  unsigned long int epoch;
+  int registered;
+};
+
+static struct tz_reader *tz_readers;
+static pthread_mutex_t tz_readers_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t tz_reader_key;
+static pthread_once_t tz_reader_once = PTHREAD_ONCE_INIT;
+static __thread struct tz_reader tz_reader_self;
+static unsigned long int tz_epoch = 1;
+
+static void
+reader_unregister (void *arg)
+{
+  struct tz_reader *r = arg, **p;
+
+  pthread_mutex_lock (&tz_readers_lock);
+  for (p = &tz_readers; *p != NULL; p = &(*p)->next)
+    if (*p == r)
+      {
+	*p = r->next;
+	break;
+      }
+  pthread_mutex_unlock (&tz_readers_lock);
+}
+
+static void
+reader_key_init (void)
+{
+  pthread_key_create (&tz_reader_key, reader_unregister);
+}
+
+static void
+reader_register (struct tz_reader *r)
+{
+  pthread_once (&tz_reader_once, reader_key_init);
+  pthread_mutex_lock (&tz_readers_lock);
+  r->next = tz_readers;
+  tz_readers = r;
+  pthread_mutex_unlock (&tz_readers_lock);
+  /* Unregister when the thread exits, as its record goes with it.  */
+  pthread_setspecific (tz_reader_key, r);
+  r->registered = 1;
+}
+
+static struct tz_reader *
+reader_enter (void)
+{
+  struct tz_reader *r = &tz_reader_self;
+
+  if (__builtin_expect (!r->registered, 0))
+    reader_register (r);
+  __atomic_store_n (&r->epoch, __atomic_load_n (&tz_epoch, __ATOMIC_RELAXED),
+		    __ATOMIC_RELAXED);
+  /* The epoch must be visible before we look at any pointer.  */
+  __atomic_thread_fence (__ATOMIC_SEQ_CST);
+  return r;
+}
+
+static void
+reader_exit (struct tz_reader *r)
+{
+  __atomic_store_n (&r->epoch, 0, __ATOMIC_RELEASE);
+}
+
+/* Wait until no reader can still hold a pointer that was unpublished
+   before the call.  */
+static void
+reader_synchronize (void)
+{
+  unsigned long int target;
+  struct tz_reader *r;
+
+  target = __atomic_add_fetch (&tz_epoch, 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_lock (&tz_readers_lock);
+  for (r = tz_readers; r != NULL; r = r->next)
+    for (;;)
+      {
+	unsigned long int epoch = __atomic_load_n (&r->epoch,
+						   __ATOMIC_ACQUIRE);
+
+	if (epoch == 0 || epoch >= target)
+	  break;
+	sched_yield ();
+      }
+  pthread_mutex_unlock (&tz_readers_lock);
+}
+
+/* Make ZONE the process zone and free the one it replaces once no
+   reader can be using it.  Must be called with `tzfile_lock' held.  */
+static void
+tzfile_publish (struct tz_zone *zone)
+{
+  struct tz_zone *old;
+
+  old = __atomic_exchange_n (&tzfile_zone, zone, __ATOMIC_SEQ_CST);
+  if (zone != NULL)
+    {
+      __tzname[0] = zone->tzname[0];
+      __tzname[1] = zone->tzname[1];
+
+      compute_tzname_max (zone);
+
+      __daylight = zone->rule_stdoff != zone->rule_dstoff;
+      __timezone = -zone->rule_stdoff;
+    }
+  if (old != NULL)
+    {
+      reader_synchronize ();
+      tzfile_free (old);
+    }
+}
+
+/* Nonzero while the watcher thread started by tz_watch_start runs.  */
+static int tz_watching;
+
+void
+__tzfile_read (const char *file, size_t extra, char **extrap)
+{
+  int was_using_tzfile = __use_tzfile;
+  struct tz_zone *zone;
+  struct stat st;
+  char *path;
+
+  if (sizeof (time_t) != 4 && sizeof (time_t) != 8)
+    abort ();
+
+  __use_tzfile = 0;
+
+  path = tzfile_path (file);
+  pthread_mutex_lock (&tzfile_lock);
+  if (path == NULL)
+    goto ret_free_zone;
+
+  /* If we were already using tzfile, check whether the file changed.
+     While the watcher runs it does that for us, so only the name needs
+     to be the same.  */
+  zone = tzfile_zone;
+  if (was_using_tzfile && zone != NULL
+      && (__atomic_load_n (&tz_watching, __ATOMIC_ACQUIRE)
+	  ? strcmp (zone->path, path) == 0
+	  : (stat (path, &st) == 0
+	     && zone->ino == st.st_ino && zone->dev == st.st_dev
+	     && zone->mtime == st.st_mtime)))
+    {
+      /* Nothing to do.  */
+      TZ_COUNT_PROCESS (read_unchanged);
+      TZ_PROBE (read, path, 0);
+      pthread_mutex_unlock (&tzfile_lock);
+      free (path);
+      __use_tzfile = 1;
+      return;
+    }
+
+  zone = tzfile_load (path, extra, extrap, 0, NULL);
+  if (zone == NULL)
+    goto ret_free_zone;
+  TZ_COUNT_PROCESS (read_load);
+  TZ_PROBE (read, path, 1);
+  free (path);
+
+  tzfile_publish (zone);
+  pthread_mutex_unlock (&tzfile_lock);
+  __use_tzfile = 1;
+  return;
+
+ ret_free_zone:
+  TZ_COUNT_PROCESS (read_fail);
+  TZ_PROBE (read, path, -1);
+  free (path);
+  tzfile_publish (NULL);
+  pthread_mutex_unlock (&tzfile_lock);
+}
+
+static unsigned int
+zone_hash (const char *name)
+{
+  unsigned int hash = 0;
+
+  while (*name != '\0')
+    hash = hash * 31 + (unsigned char) *name++;
+  return hash % ZONE_TABLE_SIZE;
+}
+
+/* Look NAME up in the registry and take a reference to it.  Must be
+   called with `zone_table_lock' held.  */
+static struct tz_zone *
+zone_table_get (const char *name, unsigned int hash)
+{
+  struct tz_zone *zone;
+  struct tz_alias *alias;
+
+  for (zone = zone_table[hash]; zone != NULL; zone = zone->next)
+    if (strcmp (zone->name, name) == 0)
+      {
+	++zone->refcount;
+	return zone;
+      }
+  for (alias = alias_table[hash]; alias != NULL; alias = alias->next)
+    if (strcmp (alias->name, name) == 0)
+      {
+	++alias->zone->refcount;
+	return alias->zone;
+      }
+  return NULL;
+}
+
+/* Sharing zones.  Many names are links to the same file, or copies of
+   it; tzdata has backward names for most zones.  A zone loaded for the
+   registry is hashed over its decoded tables, so that files with the
+   same transitions, types, names, leap seconds and TZ string match
+   however they were encoded, and a match is confirmed table by table.
+   The name then becomes an alias of the zone already registered, and
+   the new copy is freed.  Aliases keep no zone loaded; only references
+   do.  */
+
+#define CONTENT_HASH_BASIS 0xcbf29ce484222325ULL
+#define CONTENT_HASH_PRIME 0x100000001b3ULL
+
+/* Add the 8 bytes of VALUE to HASH, FNV-1a style.  */
+static uint64_t
+content_hash_add (uint64_t hash, uint64_t value)
+{
+  int k;
+
+  for (k = 0; k < 8; ++k, value >>= 8)
+    hash = (hash ^ (value & 0xff)) * CONTENT_HASH_PRIME;
+  return hash;
+}
+
+static uint64_t
+zone_content_hash (const struct tz_zone *zone)
+{
+  uint64_t hash = CONTENT_HASH_BASIS;
+  size_t i;
+
+  hash = content_hash_add (hash, zone->num_transitions);
+  for (i = 0; i < zone->num_transitions; ++i)
+    {
+      hash = content_hash_add (hash, zone_transition (zone, i));
+      hash = content_hash_add (hash, zone->type_idxs[i]);
+    }
+  hash = content_hash_add (hash, zone->num_types);
+  for (i = 0; i < zone->num_types; ++i)
+    {
+      hash = content_hash_add (hash, zone_type_offset (zone, i));
+      hash = content_hash_add (hash, zone_type_idx (zone, i));
+      hash = content_hash_add (hash, (zone_type_isdst (zone, i)
+				      | zone_type_isstd (zone, i) << 1
+				      | zone_type_isgmt (zone, i) << 2));
+    }
+  hash = content_hash_add (hash, zone->num_chars);
+  for (i = 0; i < zone->num_chars; ++i)
+    hash = (hash ^ (unsigned char) zone->zone_names[i]) * CONTENT_HASH_PRIME;
+  hash = content_hash_add (hash, zone->num_leaps);
+  for (i = 0; i < zone->num_leaps; ++i)
+    {
+      hash = content_hash_add (hash, zone_leap_transition (zone, i));
+      hash = content_hash_add (hash, zone_leap_change (zone, i));
+    }
+  if (zone->tzspec != NULL)
+    for (i = 0; zone->tzspec[i] != '\0'; ++i)
+      hash = (hash ^ (unsigned char) zone->tzspec[i]) * CONTENT_HASH_PRIME;
+  return hash;
+}
+
+/* Return nonzero if A and B answer every lookup alike.  */
+static int
+zone_same_content (const struct tz_zone *a, const struct tz_zone *b)
+{
+  size_t i;
+
+  if (a->content_hash != b->content_hash
+      || a->num_transitions != b->num_transitions
+      || a->num_types != b->num_types
+      || a->num_chars != b->num_chars
+      || a->num_leaps != b->num_leaps
+      || a->windowed || b->windowed
+      || memcmp (a->zone_names, b->zone_names, a->num_chars) != 0
+      || (a->tzspec == NULL) != (b->tzspec == NULL)
+      || (a->tzspec != NULL && strcmp (a->tzspec, b->tzspec) != 0))
+    return 0;
+  for (i = 0; i < a->num_transitions; ++i)
+    if (zone_transition (a, i) != zone_transition (b, i)
+	|| a->type_idxs[i] != b->type_idxs[i])
+      return 0;
+  for (i = 0; i < a->num_types; ++i)
+    if (zone_type_offset (a, i) != zone_type_offset (b, i)
+	|| zone_type_idx (a, i) != zone_type_idx (b, i)
+	|| zone_type_isdst (a, i) != zone_type_isdst (b, i)
+	|| zone_type_isstd (a, i) != zone_type_isstd (b, i)
+	|| zone_type_isgmt (a, i) != zone_type_isgmt (b, i))
+      return 0;
+  for (i = 0; i < a->num_leaps; ++i)
+    if (zone_leap_transition (a, i) != zone_leap_transition (b, i)
+	|| zone_leap_change (a, i) != zone_leap_change (b, i))
+      return 0;
+  return 1;
+}
+
+/* Return the registered zone with the same content as ZONE, or NULL.
+   Must be called with `zone_table_lock' held.  */
+static struct tz_zone *
+content_table_find (const struct tz_zone *zone)
+{
+  struct tz_zone *other;
+
+  for (other = content_table[zone->content_hash % ZONE_TABLE_SIZE];
+       other != NULL; other = other->content_next)
+    if (zone_same_content (zone, other))
+      return other;
+  return NULL;
+}
+
+/* Enter ZONE in the content table.  Must be called with
+   `zone_table_lock' held.  */
+static void
+content_table_add (struct tz_zone *zone)
+{
+  struct tz_zone **head = &content_table[zone->content_hash
+					 % ZONE_TABLE_SIZE];
+
+  zone->content_next = *head;
+  *head = zone;
+}
+
+/* Take ALIAS out of `alias_table'.  Must be called with
+   `zone_table_lock' held.  */
+static void
+alias_unlink (struct tz_alias *alias)
+{
+  struct tz_alias **p;
+
+  for (p = &alias_table[zone_hash (alias->name)]; *p != NULL;
+       p = &(*p)->next)
+    if (*p == alias)
+      {
+	*p = alias->next;
+	break;
+      }
+}
+
+/* Free the aliases chained from ALIASES through their ZONE_NEXT.  */
+static void
+alias_free (struct tz_alias *aliases)
+{
+  struct tz_alias *next;
+
+  for (; aliases != NULL; aliases = next)
+    {
+      next = aliases->zone_next;
+      free (aliases->name);
+      free (aliases->path);
+      free (aliases);
+    }
+}
+
+/* Take ZONE out of the registry, under its name and its content, and
+   return its aliases, taken out too, to be given to alias_free once
+   the lock is dropped.  Must be called with `zone_table_lock' held.  */
+static struct tz_alias *
+zone_table_remove (struct tz_zone *zone)
+{
+  struct tz_alias *aliases, *alias;
+  struct tz_zone **p;
+
+  for (p = &zone_table[zone_hash (zone->name)]; *p != NULL;
+       p = &(*p)->next)
+    if (*p == zone)
+      {
+	*p = zone->next;
+	break;
+      }
+  for (p = &content_table[zone->content_hash % ZONE_TABLE_SIZE];
+       *p != NULL; p = &(*p)->content_next)
+    if (*p == zone)
+      {
+	*p = zone->content_next;
+	break;
+      }
+  aliases = zone->aliases;
+  zone->aliases = NULL;
+  for (alias = aliases; alias != NULL; alias = alias->zone_next)
+    alias_unlink (alias);
+  return aliases;
+}
+
+/* Return the zone registered as NAME, taking a reference, or else
+   make one with LOAD (NAME, CLOSURE) and register it.  */
+static struct tz_zone *
+zone_table_open (const char *name,
+		 struct tz_zone *(*load) (const char *, void *),
+		 void *closure)
+{
+  struct tz_zone *zone, *other;
+  struct tz_alias *alias;
+  unsigned int hash;
+
+  hash = zone_hash (name);
+
+  pthread_mutex_lock (&zone_table_lock);
+  zone = zone_table_get (name, hash);
+  pthread_mutex_unlock (&zone_table_lock);
+  if (zone != NULL)
+    {
+      TZ_COUNT_PROCESS (open_hit);
+      return zone;
+    }
+  TZ_COUNT_PROCESS (open_miss);
+
+  /* Load the zone without holding the lock, so that a slow load does
+     not hold up lookups of zones that are already present.  */
+  zone = load (name, closure);
+  if (zone == NULL)
+    return NULL;
+  zone->name = strdup (name);
+  if (zone->name == NULL)
+    {
+      tzfile_free (zone);
+      return NULL;
+    }
+  zone->content_hash = zone_content_hash (zone);
+  /* Without memory for an alias the zone is simply not shared.  */
+  alias = calloc (1, sizeof (struct tz_alias));
+  if (alias != NULL)
+    {
+      struct tz_memory_stats st;
+
+      tz_memory_stats (zone, &st);
+      alias->saved = st.total;
+    }
+
+  pthread_mutex_lock (&zone_table_lock);
+  other = zone_table_get (name, hash);
+  if (other == NULL && alias != NULL
+      && (other = content_table_find (zone)) != NULL)
+    {
+      /* The same zone is registered under another name.  The
+	 reference is the caller's; the alias takes none.  */
+      ++other->refcount;
+      alias->zone = other;
+      alias->name = zone->name;
+      alias->path = zone->path;
+      alias->dev = zone->dev;
+      alias->ino = zone->ino;
+      alias->mtime = zone->mtime;
+      zone->name = zone->path = NULL;
+      alias->next = alias_table[hash];
+      alias_table[hash] = alias;
+      alias->zone_next = other->aliases;
+      other->aliases = alias;
+      alias = NULL;
+    }
+  else if (other == NULL)
+    {
+      zone->next = zone_table[hash];
+      zone_table[hash] = zone;
+      content_table_add (zone);
+    }
+  pthread_mutex_unlock (&zone_table_lock);
+  free (alias);
+
+  if (other != NULL)
+    {
+      /* Somebody else loaded it while we were reading, or it is
+	 shared.  */
+      tzfile_free (zone);
+      zone = other;
+    }
+  return zone;
+}
+
+/* Load NAME from TZDIR for zone_table_open.  */
+static struct tz_zone *
+tzfile_load_name (const char *name, void *closure)
+{
+  struct tz_zone *zone;
+  char *path;
+
+  path = tzfile_path (name);
+  if (path == NULL)
+    return NULL;
+  zone = tzfile_load (path, 0, NULL, 1, NULL);
+  free (path);
+  return zone;
+}
+
+struct tz_zone *
+tz_zone_open (const char *name)
+{
+  if (name == NULL)
+    name = TZDEFAULT;
+  return zone_table_open (name, tzfile_load_name, NULL);
+}
+
+struct tz_zone *
+tz_zone_open_window (const char *name, time_t from, time_t to)
+{
+  struct tz_window window;
+  struct tz_zone *zone;
+  char *path;
+
+  if (from >= to)
+    {
+      errno = EINVAL;
+      return NULL;
+    }
+  window.from = from;
+  window.to = to;
+
+  path = tzfile_path (name == NULL ? TZDEFAULT : name);
+  if (path == NULL)
+    return NULL;
+  zone = tzfile_load (path, 0, NULL, 1, &window);
+  free (path);
+  return zone;
+}
+
+void
+tz_zone_close (struct tz_zone *zone)
+{
+  struct tz_alias *aliases = NULL;
+
+  if (zone == NULL)
+    return;
+
+  pthread_mutex_lock (&zone_table_lock);
+  if (--zone->refcount > 0)
+    zone = NULL;
+  else if (zone->name != NULL)
+    aliases = zone_table_remove (zone);
+  pthread_mutex_unlock (&zone_table_lock);
+
+  alias_free (aliases);
+  tzfile_free (zone);
+}
+
+void
+tz_dedup_stats (struct tz_dedup_stats *stats)
+{
+  struct tz_zone *zone;
+  struct tz_alias *alias;
+  unsigned int h;
+
+  memset (stats, 0, sizeof *stats);
+  pthread_mutex_lock (&zone_table_lock);
+  for (h = 0; h < ZONE_TABLE_SIZE; ++h)
+    {
+      for (zone = zone_table[h]; zone != NULL; zone = zone->next)
+	++stats->zones;
+      for (alias = alias_table[h]; alias != NULL; alias = alias->next)
+	{
+	  ++stats->aliases;
+	  stats->saved += alias->saved;
+	}
+    }
+  pthread_mutex_unlock (&zone_table_lock);
+}
+
+/* Preloading.  tz_preload hands the names out one at a time to a pool
+   of threads, the caller's among them, each of which opens its zones
+   through the registry as tz_zone_open does.  A zone is registered as
+   soon as it is parsed, so it can be opened while the rest load.  There
+   are more threads than CPUs, since the page faults of a cold tree
+   leave them waiting for the disk; the deeper queue is what gets it
+   done sooner.  */
+
+/* Most threads tz_preload runs, and the fewest it runs on any number
+   of CPUs when there are that many names.  */
+#define PRELOAD_MAX_THREADS 64
+#define PRELOAD_MIN_THREADS 8
+
+struct tz_preload
+{
+  const char *const *names;
+  struct tz_zone **zones;
+  size_t n;
+  size_t next;			/* Next name to load.  */
+  size_t loaded;		/* Zones loaded so far.  */
+};
+
+static void *
+preload_main (void *arg)
+{
+  struct tz_preload *pl = arg;
+  size_t i, loaded = 0;
+
+  while ((i = __atomic_fetch_add (&pl->next, 1, __ATOMIC_RELAXED)) < pl->n)
+    {
+      struct tz_zone *zone = tz_zone_open (pl->names[i]);
+
+      if (zone != NULL)
+	++loaded;
+      if (pl->zones != NULL)
+	pl->zones[i] = zone;
+    }
+  __atomic_add_fetch (&pl->loaded, loaded, __ATOMIC_RELAXED);
+  return NULL;
+}
+
+size_t
+tz_preload (const char *const names[], size_t n, struct tz_zone *zones[])
+{
+  pthread_t threads[PRELOAD_MAX_THREADS - 1];
+  struct tz_preload pl;
+  long int cpus;
+  size_t nthreads, started, i;
+
+  pl.names = names;
+  pl.zones = zones;
+  pl.n = n;
+  pl.next = 0;
+  pl.loaded = 0;
+
+  cpus = sysconf (_SC_NPROCESSORS_ONLN);
+  nthreads = cpus > PRELOAD_MIN_THREADS / 2 ? 2 * cpus : PRELOAD_MIN_THREADS;
+  if (nthreads > PRELOAD_MAX_THREADS)
+    nthreads = PRELOAD_MAX_THREADS;
+  if (nthreads > n)
+    nthreads = n;
+
+  /* If a thread cannot be started, the others take its share.  */
+  for (started = 0; started + 1 < nthreads; ++started)
+    if (pthread_create (&threads[started], NULL, preload_main, &pl) != 0)
+      break;
+  preload_main (&pl);
+  for (i = 0; i < started; ++i)
+    pthread_join (threads[i], NULL);
+  return pl.loaded;
+}
+
+void
+tz_string_stats (struct tz_zone *zone, struct tz_string_stats *stats)
+{
+  if (zone != NULL && zone->strings != NULL)
+    *stats = zone->strings->stats;
+  else
+    {
+      pthread_mutex_lock (&tzstrings_lock);
+      *stats = tzstrings.stats;
+      pthread_mutex_unlock (&tzstrings_lock);
+    }
+}
+
+/* Hot reload.  The watcher thread gets inotify events for TZDIR, its
+   subdirectories and the directory holding TZDEFAULT.  Package
+   upgrades replace many files in a burst, so after an event it waits
+   for WATCH_SETTLE_MS of quiet and then checks every loaded zone
+   against its file.  Changed zones are loaded by the watcher and
+   swapped in: the process zone through tzfile_publish, registered
+   zones by replacing their registry entry.  Handles already open keep
+   the zone they have until they close it.  */
+
+#define WATCH_MASK \
+  (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_ATTRIB)
+#define WATCH_SETTLE_MS 200
+
+static pthread_mutex_t tz_watch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t tz_watch_thread;
+static int tz_watch_fd = -1;
+static int tz_watch_wake[2] = { -1, -1 };
+
+static int
+watch_add_dir (const char *path, const struct stat *sb, int flag,
+	       struct FTW *ftw)
+{
+  if (flag == FTW_D)
+    inotify_add_watch (tz_watch_fd, path, WATCH_MASK);
+  return 0;
+}
+
+/* Watch TZDIR and everything below it.  Directories already watched
+   keep their watch.  */
+static void
+watch_add_tree (void)
+{
+  nftw (tzfile_dir (), watch_add_dir, 16, FTW_PHYS);
+}
+
+/* Return nonzero if the file at PATH, read when it had DEV, INO and
+   MTIME, has been replaced or modified.  A file that is missing, as it
+   may be for a moment during an upgrade, does not count as changed.  */
+static int
+file_changed (const char *path, dev_t dev, ino_t ino, time_t mtime)
+{
+  struct stat st;
+
+  return (stat (path, &st) == 0
+	  && (ino != st.st_ino || dev != st.st_dev || mtime != st.st_mtime));
+}
+
+static int
+zone_changed (const struct tz_zone *zone)
+{
+  return file_changed (zone->path, zone->dev, zone->ino, zone->mtime);
+}
+
+/* Drop the aliases of ZONE whose files have changed, so that their
+   names are loaded again when next opened.  The caller holds a
+   reference to ZONE, so only this thread takes its aliases away; those
+   added meanwhile go in front of the list and are left for next time.  */
+static void
+watch_check_aliases (struct tz_zone *zone)
+{
+  struct tz_alias *alias, *next, **p, *changed = NULL;
+
+  pthread_mutex_lock (&zone_table_lock);
+  alias = zone->aliases;
+  pthread_mutex_unlock (&zone_table_lock);
+
+  for (; alias != NULL; alias = next)
+    {
+      next = alias->zone_next;
+      if (alias->path == NULL
+	  || !file_changed (alias->path, alias->dev, alias->ino,
+			    alias->mtime))
+	continue;
+      pthread_mutex_lock (&zone_table_lock);
+      for (p = &zone->aliases; *p != alias; p = &(*p)->zone_next)
+	;
+      *p = alias->zone_next;
+      alias_unlink (alias);
+      pthread_mutex_unlock (&zone_table_lock);
+      alias->zone_next = changed;
+      changed = alias;
+    }
+  alias_free (changed);
+}
+
+static void
+watch_reload_process_zone (void)
+{
+  struct tz_zone *zone, *new;
+
+  pthread_mutex_lock (&tzfile_lock);
+  zone = tzfile_zone;
+  /* A zone loaded with an EXTRA block (posixrules for __tzfile_default)
+     holds caller data we cannot reproduce; __tzfile_read reloads it
+     when it is next asked to.  */
+  if (zone != NULL && zone->extra == NULL && zone_changed (zone))
+    {
+      new = tzfile_load (zone->path, 0, NULL, 0, NULL);
+      if (new != NULL)
+	{
+	  TZ_COUNT_PROCESS (reload);
+	  TZ_PROBE (reload, new->path, new);
+	  tzfile_publish (new);
+	}
+    }
+  pthread_mutex_unlock (&tzfile_lock);
+}
+
+static void
+watch_reload_registry (void)
+{
+  struct tz_zone **pinned = NULL, *zone, *new, **p;
+  struct tz_alias *aliases;
+  size_t n = 0, max = 0, i;
+  unsigned int h;
+
+  /* Take a reference to every file-backed zone, so that they can be
+     checked and reloaded without holding the lock.  */
+  pthread_mutex_lock (&zone_table_lock);
+  for (h = 0; h < ZONE_TABLE_SIZE; ++h)
+    for (zone = zone_table[h]; zone != NULL; zone = zone->next)
+      if (zone->path != NULL)
+	{
+	  if (n == max)
+	    {
+	      struct tz_zone **tmp;
+
+	      max = max * 2 + 64;
+	      tmp = realloc (pinned, max * sizeof (struct tz_zone *));
+	      if (tmp == NULL)
+		goto out;
+	      pinned = tmp;
+	    }
+	  ++zone->refcount;
+	  pinned[n++] = zone;
+	}
+ out:
+  pthread_mutex_unlock (&zone_table_lock);
+
+  for (i = 0; i < n; ++i)
+    {
+      zone = pinned[i];
+      if (!zone_changed (zone))
+	{
+	  watch_check_aliases (zone);
+	  continue;
+	}
+      new = tzfile_load (zone->path, 0, NULL, 1, NULL);
+      if (new == NULL)
+	continue;
+      new->name = strdup (zone->name);
+      if (new->name == NULL)
+	{
+	  tzfile_free (new);
+	  continue;
+	}
+      new->content_hash = zone_content_hash (new);
+
+      /* The registry holds no reference of its own, so the new zone
+	 enters it unreferenced and stays cached until it is next opened
+	 and closed.  The aliases of the old one are dropped, to be
+	 matched again when they are next opened.  */
+      new->refcount = 0;
+      aliases = NULL;
+      pthread_mutex_lock (&zone_table_lock);
+      for (p = &zone_table[zone_hash (zone->name)]; *p != NULL;
+	   p = &(*p)->next)
+	if (*p == zone)
+	  {
+	    TZ_COUNT_PROCESS (reload);
+	    TZ_PROBE (reload, new->path, new);
+	    new->next = zone->next;
+	    *p = new;
+	    aliases = zone_table_remove (zone);
+	    content_table_add (new);
+	    new = NULL;
+	    break;
+	  }
+      pthread_mutex_unlock (&zone_table_lock);
+      alias_free (aliases);
+      tzfile_free (new);
+    }
+
+  for (i = 0; i < n; ++i)
+    tz_zone_close (pinned[i]);
+  free (pinned);
+}
+
+static void *
+watch_main (void *arg)
+{
+  struct pollfd pfd[2];
+  char buf[4096]
+    __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+  int pending = 0;
+
+  pfd[0].fd = tz_watch_fd;
+  pfd[0].events = POLLIN;
+  pfd[1].fd = tz_watch_wake[0];
+  pfd[1].events = POLLIN;
+
+  for (;;)
+    {
+      int n = poll (pfd, 2, pending ? WATCH_SETTLE_MS : -1);
+
+      if (n < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  break;
+	}
+      if (pfd[1].revents != 0)
+	break;
+      if (n == 0)
+	{
+	  pending = 0;
+	  watch_reload_process_zone ();
+	  watch_reload_registry ();
+	  continue;
+	}
+      if (pfd[0].revents & POLLIN)
+	{
+	  ssize_t len = read (tz_watch_fd, buf, sizeof buf);
+	  char *p;
+
+	  for (p = buf; len > 0 && p < buf + len; )
+	    {
+	      const struct inotify_event *ev
+		= (const struct inotify_event *) p;
+
+	      /* New directories need watches of their own.  */
+	      if ((ev->mask & IN_ISDIR)
+		  && (ev->mask & (IN_CREATE | IN_MOVED_TO)))
+		watch_add_tree ();
+	      p += sizeof (struct inotify_event) + ev->len;
+	    }
+	  pending = 1;
+	}
+    }
+  return NULL;
+}
+
+int
+tz_watch_start (void)
+{
+  char *path, *slash;
+  int result = -1;
+
+  pthread_mutex_lock (&tz_watch_lock);
+  if (tz_watching)
+    {
+      result = 0;
+      goto out;
+    }
+
+  tz_watch_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+  if (tz_watch_fd < 0)
+    goto out;
+  if (pipe2 (tz_watch_wake, O_CLOEXEC) != 0)
+    goto lose;
+
+  watch_add_tree ();
+  /* TZDEFAULT is usually a link outside TZDIR, replaced by renaming a
+     new link over it, so watch the directory it is in.  */
+  path = tzfile_path (NULL);
+  if (path != NULL)
+    {
+      slash = strrchr (path, '/');
+      if (slash != NULL && slash != path)
+	{
+	  *slash = '\0';
+	  inotify_add_watch (tz_watch_fd, path, WATCH_MASK);
+	}
+      free (path);
+    }
+
+  if (pthread_create (&tz_watch_thread, NULL, watch_main, NULL) != 0)
+    goto lose;
+  __atomic_store_n (&tz_watching, 1, __ATOMIC_RELEASE);
+  result = 0;
+  goto out;
+
+ lose:
+  close (tz_watch_fd);
+  tz_watch_fd = -1;
+  if (tz_watch_wake[0] >= 0)
+    {
+      close (tz_watch_wake[0]);
+      close (tz_watch_wake[1]);
+      tz_watch_wake[0] = tz_watch_wake[1] = -1;
+    }
+ out:
+  pthread_mutex_unlock (&tz_watch_lock);
+  return result;
+}
+
+void
+tz_watch_stop (void)
+{
+  pthread_mutex_lock (&tz_watch_lock);
+  if (tz_watching)
+    {
+      /* From now on __tzfile_read checks the file itself again.  */
+      __atomic_store_n (&tz_watching, 0, __ATOMIC_RELEASE);
+      while (write (tz_watch_wake[1], "", 1) < 0 && errno == EINTR)
+	continue;
+      pthread_join (tz_watch_thread, NULL);
+      close (tz_watch_fd);
+      close (tz_watch_wake[0]);
+      close (tz_watch_wake[1]);
+      tz_watch_fd = tz_watch_wake[0] = tz_watch_wake[1] = -1;
+    }
+  pthread_mutex_unlock (&tz_watch_lock);
+}
+
+/* Packed zone databases, as written by tzdb_build; the format is
+   described in tzzone-internal.h.  */
+
+struct tz_db
+{
+  void *map;
+  size_t size;
+  unsigned int refcount;	/* The opener's, plus one per zone.  */
+  size_t num_zones;
+  const unsigned char *records;
+};
+
+static inline uint32_t
+tzdb_field (const struct tz_db *db, size_t rec, int field)
+{
+  return (uint32_t) decode (db->records + (rec * TZDB_FIELDS + field) * 4);
+}
+
+/* Return whether the string at OFF in DB is NUL-terminated in the
+   file.  */
+static int
+tzdb_string_ok (const struct tz_db *db, uint32_t off)
+{
+  return (off >= TZDB_HEADER && off < db->size
+	  && memchr ((const char *) db->map + off, '\0', db->size - off)
+	     != NULL);
+}
+
+struct tz_db *
+tz_db_open (const char *path)
+{
+  const unsigned char *head;
+  struct tz_db *db;
+  struct stat st;
+  size_t i;
+  void *map;
+  int fd;
+
+  /* The tables hold 8-byte times only.  */
+  if (sizeof (time_t) != 8)
+    return NULL;
+
+  fd = open (path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return NULL;
+  if (fstat (fd, &st) != 0 || st.st_size < TZDB_HEADER)
+    {
+      close (fd);
+      return NULL;
+    }
+  map = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (map == MAP_FAILED)
+    return NULL;
+
+  db = malloc (sizeof (struct tz_db));
+  if (db == NULL)
+    goto lose;
+  head = map;
+  db->map = map;
+  db->size = st.st_size;
+  db->refcount = 1;
+  db->num_zones = (uint32_t) decode (head + 8);
+  db->records = head + TZDB_HEADER;
+
+  if (memcmp (head, TZDB_MAGIC, 4) != 0
+      || (uint32_t) decode (head + 4) != TZDB_VERSION
+      || (uint32_t) decode (head + 12) != db->size
+      || db->num_zones > (db->size - TZDB_HEADER) / (TZDB_FIELDS * 4))
+    goto lose;
+
+  /* Check the names once here, so that lookups can compare them
+     without bounds checks.  */
+  for (i = 0; i < db->num_zones; ++i)
+    if (!tzdb_string_ok (db, tzdb_field (db, i, TZDB_NAME)))
+      goto lose;
+
+  return db;
+
+ lose:
+  munmap (map, st.st_size);
+  free (db);
+  return NULL;
+}
+
+void
+tz_db_close (struct tz_db *db)
+{
+  if (db != NULL
+      && __atomic_sub_fetch (&db->refcount, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+      munmap (db->map, db->size);
+      free (db);
+    }
+}
+
+/* Return a pointer to COUNT elements of WIDTH bytes at field OFF_FIELD
+   of record REC, or NULL if they do not lie within DB.  */
+static const unsigned char *
+tzdb_table (const struct tz_db *db, size_t rec, int off_field,
+	    size_t count, size_t width)
+{
+  uint32_t off = tzdb_field (db, rec, off_field);
+
+  if (off > db->size || count > (db->size - off) / width)
+    return NULL;
+  return (const unsigned char *) db->map + off;
+}
+
+/* Make a new, unregistered zone for NAME out of DB.  */
+static struct tz_zone *
+tzdb_load (const char *name, void *closure)
+{
+  struct tz_db *db = closure;
+  struct tz_zone *zone;
+  size_t lo = 0, hi = db->num_zones, rec;
+  uint32_t tzspec;
+
+  /* Find NAME.  */
+  while (lo < hi)
+    {
+      size_t i = (lo + hi) / 2;
+      int cmp = strcmp (name, ((const char *) db->map
+			       + tzdb_field (db, i, TZDB_NAME)));
+
+      if (cmp == 0)
+	break;
+      if (cmp < 0)
+	hi = i;
+      else
+	lo = i + 1;
+    }
+  if (lo >= hi)
+    return NULL;
+  rec = (lo + hi) / 2;
+
+  zone = calloc (1, sizeof (struct tz_zone));
+  if (zone == NULL)
+    return NULL;
+  zone->refcount = 1;
+  zone->strings = strtab_new ();
+  zone->trans_width = 8;
+  zone->num_transitions = tzdb_field (db, rec, TZDB_TIMECNT);
+  zone->num_types = tzdb_field (db, rec, TZDB_TYPECNT);
+  zone->num_chars = tzdb_field (db, rec, TZDB_CHARCNT);
+  zone->num_leaps = tzdb_field (db, rec, TZDB_LEAPCNT);
+  zone->num_isstd = tzdb_field (db, rec, TZDB_ISSTDCNT);
+  zone->num_isgmt = tzdb_field (db, rec, TZDB_ISGMTCNT);
+  zone->transitions = tzdb_table (db, rec, TZDB_TIMES,
+				  zone->num_transitions, 8);
+  zone->type_idxs = tzdb_table (db, rec, TZDB_IDXS,
+				zone->num_transitions, 1);
+  zone->types = tzdb_table (db, rec, TZDB_TYPES, zone->num_types, 6);
+  zone->zone_names = (const char *) tzdb_table (db, rec, TZDB_CHARS,
+						zone->num_chars, 1);
+  zone->leaps = tzdb_table (db, rec, TZDB_LEAPS, zone->num_leaps, 12);
+  zone->isstd = tzdb_table (db, rec, TZDB_ISSTD, zone->num_isstd, 1);
+  zone->isgmt = tzdb_table (db, rec, TZDB_ISGMT, zone->num_isgmt, 1);
+  tzspec = tzdb_field (db, rec, TZDB_TZSPEC);
+
+  if (zone->transitions == NULL || zone->type_idxs == NULL
+      || zone->types == NULL || zone->zone_names == NULL
+      || zone->leaps == NULL || zone->isstd == NULL || zone->isgmt == NULL
+      || (tzspec != 0 && !tzdb_string_ok (db, tzspec))
+      || zone_check (zone) != 0)
+    goto lose;
+  if (tzspec != 0)
+    zone->tzspec = tz_intern (zone->strings,
+			      (const char *) db->map + tzspec);
+  if (zone_setup (zone) != 0)
+    goto lose;
+
+  __atomic_add_fetch (&db->refcount, 1, __ATOMIC_RELAXED);
+  zone->db = db;
+  return zone;
+
+ lose:
+  zone_free_tables (zone);
+  free (zone);
+  return NULL;
+}
+
+struct tz_zone *
+tz_db_zone (struct tz_db *db, const char *name)
+{
+  if (db == NULL || name == NULL)
+    return NULL;
+  return zone_table_open (name, tzdb_load, db);
+}
+
+/* TZif images.  A zone in decoded form is written out in the format
+   of a zone file, so that zones made in memory are validated and read
+   by the same code as files.  */
+
+struct tzif_type
+{
+  int32_t utoff;
+  unsigned char isdst;
+  unsigned char abbrind;
+};
+
+struct tzif_data
+{
+  size_t timecnt;
+  const int64_t *times;
+  const unsigned char *idxs;
+  size_t typecnt;
+  const struct tzif_type *types;
+  size_t charcnt;
+  const char *chars;
+  size_t leapcnt;
+  const int64_t *leap_times;
+  const int32_t *leap_corrs;
+  const char *footer;		/* TZ string, or NULL.  */
+  char version;			/* '2' or '3'.  */
+  int slim;			/* Leave the version 1 block empty.  */
+};
+
+static unsigned char *
+tzif_put (unsigned char *p, uint64_t v, int width)
+{
+  int i;
+
+  for (i = 0; i < width; ++i)
+    p[i] = v >> ((width - 1 - i) * 8);
+  return p + width;
+}
+
+/* Write the header and data block of D at P with times of WIDTH bytes.
+   The 4-byte block only has the times that fit.  */
+static unsigned char *
+tzif_block (unsigned char *p, const struct tzif_data *d, int width)
+{
+  size_t lo = 0, hi = d->timecnt, llo = 0, lhi = d->leapcnt, i;
+
+  if (width == 4)
+    {
+      while (lo < hi && d->times[lo] < INT32_MIN)
+	++lo;
+      while (hi > lo && d->times[hi - 1] > INT32_MAX)
+	--hi;
+      while (llo < lhi && d->leap_times[llo] < INT32_MIN)
+	++llo;
+      while (lhi > llo && d->leap_times[lhi - 1] > INT32_MAX)
+	--lhi;
+    }
+
+  memcpy (p, TZ_MAGIC, 4);
+  p[4] = d->version;
+  memset (p + 5, 0, 15);
+  p = tzif_put (p + 20, 0, 4);		/* ttisgmtcnt */
+  p = tzif_put (p, 0, 4);		/* ttisstdcnt */
+  p = tzif_put (p, lhi - llo, 4);
+  p = tzif_put (p, hi - lo, 4);
+  p = tzif_put (p, d->typecnt, 4);
+  p = tzif_put (p, d->charcnt, 4);
+
+  for (i = lo; i < hi; ++i)
+    p = tzif_put (p, d->times[i], width);
+  for (i = lo; i < hi; ++i)
+    *p++ = d->idxs[i];
+  for (i = 0; i < d->typecnt; ++i)
+    {
+      p = tzif_put (p, (uint32_t) d->types[i].utoff, 4);
+      *p++ = d->types[i].isdst;
+      *p++ = d->types[i].abbrind;
+    }
+  memcpy (p, d->chars, d->charcnt);
+  p += d->charcnt;
+  for (i = llo; i < lhi; ++i)
+    {
+      p = tzif_put (p, d->leap_times[i], width);
+      p = tzif_put (p, (uint32_t) d->leap_corrs[i], 4);
+    }
+  return p;
+}
+
+/* Return D as a TZif image allocated with malloc, and its size in
+   *SIZEP; NULL if memory runs out.  */
+static unsigned char *
+tzif_image (const struct tzif_data *d, size_t *sizep)
+{
+  size_t footer = d->footer == NULL ? 0 : strlen (d->footer);
+  size_t size = (2 * sizeof (struct tzhead)
+		 + d->timecnt * 14 + d->typecnt * 12 + d->charcnt * 2
+		 + d->leapcnt * 20 + footer + 2);
+  unsigned char *image, *p;
+
+  image = malloc (size);
+  if (image == NULL)
+    return NULL;
+  if (d->slim)
+    {
+      /* Readers of version 1 see one type, UTC, as from zic -b slim.  */
+      static const struct tzif_type utc;
+      struct tzif_data empty =
+	{ .typecnt = 1, .types = &utc, .charcnt = 1, .chars = "",
+	  .version = d->version };
+
+      p = tzif_block (image, &empty, 4);
+    }
+  else
+    p = tzif_block (image, d, 4);
+  p = tzif_block (p, d, 8);
+  *p++ = '\n';
+  memcpy (p, d->footer == NULL ? "" : d->footer, footer);
+  p += footer;
+  *p++ = '\n';
+  *sizep = p - image;
+  return image;
+}
+
+/* Make an unregistered zone from the image of D.  */
+static struct tz_zone *
+tzif_zone (const struct tzif_data *d)
+{
+  struct tz_zone *zone;
+  unsigned char *image;
+  size_t size;
+
+  image = tzif_image (d, &size);
+  if (image == NULL)
+    return NULL;
+  zone = tzfile_parse (image, size, 0, NULL, 1, NULL);
+  if (zone == NULL)
+    {
+      free (image);
+      return NULL;
+    }
+  zone->map_heap = 1;
+  return zone;
+}
+
+/* Compiling zic source.  The Rule, Zone and Link lines of zic(8) are
+   read, and the zone asked for is worked out into transitions the way
+   "zic -b slim" does it: rule transitions are made year by year through
+   the last year the zone names, after which the TZ string takes over
+   where the rules still in force can be written as one.  */
+
+#define ZIC_YEAR_MIN INT_MIN
+#define ZIC_YEAR_MAX INT_MAX
+/* Zones that start out in daylight time get a first transition here,
+   as readers take standard time to come before the first one.  */
+#define ZIC_BIG_BANG (-((int64_t) 1 << 59))
+/* Years written out either side of those named when there is no TZ
+   string: a Gregorian cycle, and a year at each end.  */
+#define ZIC_YEARS_EXTEND 402
+#define ZIC_TYPES 256
+#define ZIC_CHARS 256
+#define ZIC_ABBR 64
+
+enum
+  {
+    ZIC_ON_DAY,			/* DAY */
+    ZIC_ON_LAST,		/* lastWDAY */
+    ZIC_ON_GEQ,			/* WDAY>=DAY */
+    ZIC_ON_LEQ			/* WDAY<=DAY */
+  };
+
+struct zic_on
+{
+  int kind;
+  int day;
+  int wday;			/* 0 is Sunday.  */
+};
+
+struct zic_rule
+{
+  const char *name;
+  int from, to;
+  int month;			/* 1 to 12.  */
+  struct zic_on on;
+  long int at;
+  char at_type;			/* 'w', 's' or 'u'.  */
+  long int save;
+  int isdst;
+  const char *letter;
+};
+
+struct zic_line
+{
+  const char *name;		/* Zone name, on the first line only.  */
+  long int stdoff;
+  const char *rules;		/* Rule name, or NULL.  */
+  long int save;		/* Fixed save if RULES is NULL.  */
+  int save_isdst;
+  const char *format;
+  int has_until;
+  int until_year, until_month;
+  struct zic_on until_on;
+  long int until_at;
+  char until_type;
+};
+
+struct zic
+{
+  char *text;			/* Copy of the source; fields point here.  */
+  struct zic_rule *rules;
+  size_t num_rules, max_rules;
+  struct zic_line *lines;
+  size_t num_lines, max_lines;
+  const char *(*links)[2];	/* Target, link name.  */
+  size_t num_links, max_links;
+};
+
+/* Zone data as it is worked out.  */
+struct zic_out
+{
+  int64_t *times;
+  unsigned char *idxs;
+  size_t timecnt, max_times;
+  struct tzif_type types[ZIC_TYPES];
+  size_t typecnt;
+  char chars[ZIC_CHARS];
+  size_t charcnt;
+  int defaulttype;		/* Type before the first transition.  */
+  ssize_t lastatmax;		/* Last transition by a rule still in force.  */
+  ssize_t endat;		/* Transition marking the last year written
+				   out without a TZ string, or -1.  */
+};
+
+static const char *const zic_months[] =
+  { "January", "February", "March", "April", "May", "June", "July",
+    "August", "September", "October", "November", "December", NULL };
+static const char *const zic_wdays[] =
+  { "Sunday", "Monday", "Tuesday", "Wednesday", "Thursday", "Friday",
+    "Saturday", NULL };
+
+/* Return the index of the word in WORDS that S abbreviates, or -1 if
+   none or several do.  */
+static int
+zic_word (const char *s, const char *const *words)
+{
+  size_t len = strlen (s);
+  int i, found = -1;
+
+  if (len == 0)
+    return -1;
+  for (i = 0; words[i] != NULL; ++i)
+    if (strncasecmp (s, words[i], len) == 0)
+      {
+	if (strlen (words[i]) == len)
+	  return i;
+	if (found >= 0)
+	  return -1;
+	found = i;
+      }
+  return found;
+}
+
+/* Parse [-]h[:mm[:ss]] at S into *SECS, followed by one of the letters
+   in SUFFIXES, stored in *SUFFIX, if SUFFIX is not NULL.  "-" is zero.
+   Returns 0, or -1 if S is malformed.  */
+static int
+zic_hms (const char *s, long int *secs, const char *suffixes, char *suffix)
+{
+  long int sign = 1, part[3] = { 0, 0, 0 };
+  int i;
+
+  if (suffix != NULL)
+    *suffix = '\0';
+  if (strcmp (s, "-") == 0)
+    {
+      *secs = 0;
+      return 0;
+    }
+  if (*s == '-')
+    {
+      sign = -1;
+      ++s;
+    }
+  for (i = 0; i < 3; ++i)
+    {
+      if (!isdigit ((unsigned char) *s))
+	return -1;
+      while (isdigit ((unsigned char) *s))
+	{
+	  part[i] = part[i] * 10 + (*s++ - '0');
+	  if (part[i] > 1000000)
+	    return -1;
+	}
+      if (*s != ':')
+	break;
+      ++s;
+    }
+  /* Fractions of a second are rounded down.  */
+  if (*s == '.')
+    while (isdigit ((unsigned char) *++s))
+      continue;
+  if (*s != '\0')
+    {
+      if (suffix == NULL || strchr (suffixes, tolower ((unsigned char) *s))
+	  == NULL || s[1] != '\0')
+	return -1;
+      *suffix = tolower ((unsigned char) *s);
+    }
+  if (part[1] > 59 || part[2] > 59)
+    return -1;
+  *secs = sign * (part[0] * 3600 + part[1] * 60 + part[2]);
+  return 0;
+}
+
+/* Parse the AT field of a rule or an UNTIL.  */
+static int
+zic_at (const char *s, long int *at, char *type)
+{
+  if (zic_hms (s, at, "wsugz", type) != 0)
+    return -1;
+  if (*type == '\0')
+    *type = 'w';
+  else if (*type == 'g' || *type == 'z')
+    *type = 'u';
+  return 0;
+}
+
+static int
+zic_year (const char *s, int *year)
+{
+  static const char *const words[] = { "minimum", "maximum", NULL };
+  char *end;
+  long int y;
+
+  switch (zic_word (s, words))
+    {
+    case 0:
+      *year = ZIC_YEAR_MIN;
+      return 0;
+    case 1:
+      *year = ZIC_YEAR_MAX;
+      return 0;
+    }
+  y = strtol (s, &end, 10);
+  if (end == s || *end != '\0' || y <= -100000 || y >= 100000)
+    return -1;
+  *year = y;
+  return 0;
+}
+
+static int
+zic_parse_on (const char *s, struct zic_on *on)
+{
+  char buf[16];
+  const char *op;
+  size_t len;
+
+  if (isdigit ((unsigned char) *s))
+    {
+      char *end;
+
+      on->kind = ZIC_ON_DAY;
+      on->day = strtol (s, &end, 10);
+      return *end == '\0' && on->day >= 1 && on->day <= 31 ? 0 : -1;
+    }
+  if (strncasecmp (s, "last", 4) == 0)
+    {
+      on->kind = ZIC_ON_LAST;
+      on->wday = zic_word (s + 4, zic_wdays);
+      return on->wday < 0 ? -1 : 0;
+    }
+  op = strpbrk (s, "<>");
+  if (op == NULL || op[1] != '=' || !isdigit ((unsigned char) op[2]))
+    return -1;
+  len = op - s;
+  if (len >= sizeof buf)
+    return -1;
+  memcpy (buf, s, len);
+  buf[len] = '\0';
+  on->kind = *op == '>' ? ZIC_ON_GEQ : ZIC_ON_LEQ;
+  on->wday = zic_word (buf, zic_wdays);
+  on->day = atoi (op + 2);
+  return on->wday < 0 || on->day < 1 || on->day > 31 ? -1 : 0;
+}
+
+/* Split the line at P into at most MAX fields, in place.  Returns the
+   number found and the start of the next line in *NEXT.  */
+static int
+zic_fields (char *p, char **fields, int max, char **next)
+{
+  int n = 0;
+
+  for (;;)
+    {
+      while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\f'
+	     || *p == '\v')
+	++p;
+      if (*p == '\0' || *p == '\n' || *p == '#')
+	break;
+      if (n == max)
+	return -1;
+      if (*p == '"')
+	{
+	  fields[n++] = ++p;
+	  while (*p != '"' && *p != '\n' && *p != '\0')
+	    ++p;
+	  if (*p != '"')
+	    return -1;
+	  *p++ = '\0';
+	  continue;
+	}
+      fields[n++] = p;
+      while (*p != '\0' && !isspace ((unsigned char) *p) && *p != '#')
+	++p;
+      if (*p == '#')
+	{
+	  *p = '\0';
+	  p = strchr (p + 1, '\n');
+	  if (p == NULL)
+	    p = fields[n - 1] + strlen (fields[n - 1]);
+	  break;
+	}
+      if (*p == '\0')
+	break;
+      if (*p == '\n')
+	{
+	  *p++ = '\0';
+	  *next = p;
+	  return n;
+	}
+      *p++ = '\0';
+    }
+  if (*p == '#')
+    p += strcspn (p, "\n");
+  *next = *p == '\n' ? p + 1 : p;
+  return n;
+}
+
+/* Grow the array at *ARRAY of *MAX elements of SIZE bytes to hold one
+   more than N.  */
+static int
+zic_grow (void *array, size_t *max, size_t n, size_t size)
+{
+  void *p;
+
+  if (n < *max)
+    return 0;
+  p = realloc (*(void **) array, (*max * 2 + 16) * size);
+  if (p == NULL)
+    return -1;
+  *(void **) array = p;
+  *max = *max * 2 + 16;
+  return 0;
+}
+
+/* Parse the STDOFF RULES FORMAT [UNTIL] fields of a zone line.  */
+static int
+zic_parse_zone (struct zic_line *line, char **f, int n)
+{
+  char save_type;
+
+  if (n < 3 || n > 7 || zic_hms (f[0], &line->stdoff, NULL, NULL) != 0)
+    return -1;
+  line->rules = NULL;
+  line->save = 0;
+  line->save_isdst = 0;
+  if (strcmp (f[1], "-") != 0)
+    {
+      if (isdigit ((unsigned char) f[1][0])
+	  || (f[1][0] == '-' && isdigit ((unsigned char) f[1][1])))
+	{
+	  if (zic_hms (f[1], &line->save, "sd", &save_type) != 0)
+	    return -1;
+	  line->save_isdst = (save_type == '\0' ? line->save != 0
+			      : save_type == 'd');
+	}
+      else
+	line->rules = f[1];
+    }
+  line->format = f[2];
+
+  line->has_until = n > 3;
+  line->until_month = 1;
+  line->until_on.kind = ZIC_ON_DAY;
+  line->until_on.day = 1;
+  line->until_at = 0;
+  line->until_type = 'w';
+  if (n > 3 && (zic_year (f[3], &line->until_year) != 0
+		|| line->until_year == ZIC_YEAR_MIN
+		|| line->until_year == ZIC_YEAR_MAX))
+    return -1;
+  if (n > 4 && (line->until_month = zic_word (f[4], zic_months) + 1) == 0)
+    return -1;
+  if (n > 5 && zic_parse_on (f[5], &line->until_on) != 0)
+    return -1;
+  if (n > 6 && zic_at (f[6], &line->until_at, &line->until_type) != 0)
+    return -1;
+  return 0;
+}
+
+static int
+zic_parse_rule (struct zic_rule *r, char **f, int n)
+{
+  static const char *const only[] = { "only", NULL };
+  char save_type;
+
+  if (n != 9)
+    return -1;
+  r->name = f[0];
+  if (zic_year (f[1], &r->from) != 0 || r->from == ZIC_YEAR_MAX)
+    return -1;
+  if (zic_word (f[2], only) == 0)
+    r->to = r->from;
+  else if (zic_year (f[2], &r->to) != 0 || r->to == ZIC_YEAR_MIN
+	   || r->to < r->from)
+    return -1;
+  if ((strcmp (f[3], "-") != 0 && f[3][0] != '\0')
+      || (r->month = zic_word (f[4], zic_months) + 1) == 0
+      || zic_parse_on (f[5], &r->on) != 0
+      || zic_at (f[6], &r->at, &r->at_type) != 0
+      || zic_hms (f[7], &r->save, "sd", &save_type) != 0)
+    return -1;
+  r->isdst = save_type == '\0' ? r->save != 0 : save_type == 'd';
+  r->letter = strcmp (f[8], "-") == 0 ? "" : f[8];
+  return 0;
+}
+
+static void
+zic_free (struct zic *z)
+{
+  free (z->text);
+  free (z->rules);
+  free (z->lines);
+  free (z->links);
+}
+
+/* Read SOURCE into Z.  Returns 0, or -1 on a syntax error.  */
+static int
+zic_parse (struct zic *z, const char *source)
+{
+  static const char *const keywords[] = { "Rule", "Zone", "Link", NULL };
+  char *p, *f[10];
+  int continuation = 0;
+
+  memset (z, 0, sizeof *z);
+  z->text = strdup (source);
+  if (z->text == NULL)
+    return -1;
+
+  for (p = z->text; *p != '\0'; )
+    {
+      int n = zic_fields (p, f, 10, &p);
+
+      if (n < 0)
+	return -1;
+      if (n == 0)
+	continue;
+
+      if (continuation)
+	{
+	  if (zic_grow (&z->lines, &z->max_lines, z->num_lines,
+			sizeof (struct zic_line)) != 0
+	      || zic_parse_zone (&z->lines[z->num_lines], f, n) != 0)
+	    return -1;
+	  z->lines[z->num_lines].name = NULL;
+	  continuation = z->lines[z->num_lines++].has_until;
+	  continue;
+	}
+
+      switch (zic_word (f[0], keywords))
+	{
+	case 0:
+	  if (zic_grow (&z->rules, &z->max_rules, z->num_rules,
+			sizeof (struct zic_rule)) != 0
+	      || zic_parse_rule (&z->rules[z->num_rules], f + 1, n - 1) != 0)
+	    return -1;
+	  ++z->num_rules;
+	  break;
+
+	case 1:
+	  if (n < 2
+	      || zic_grow (&z->lines, &z->max_lines, z->num_lines,
+			   sizeof (struct zic_line)) != 0
+	      || zic_parse_zone (&z->lines[z->num_lines], f + 2, n - 2) != 0)
+	    return -1;
+	  z->lines[z->num_lines].name = f[1];
+	  continuation = z->lines[z->num_lines++].has_until;
+	  break;
+
+	case 2:
+	  if (n != 3
+	      || zic_grow (&z->links, &z->max_links, z->num_links,
+			   sizeof (*z->links)) != 0)
+	    return -1;
+	  z->links[z->num_links][0] = f[1];
+	  z->links[z->num_links][1] = f[2];
+	  ++z->num_links;
+	  break;
+
+	default:
+	  return -1;
+	}
+    }
+  return continuation ? -1 : 0;
+}
+
+static int
+zic_weekday (long long int day)
+{
+  /* 1970-01-01 was a Thursday.  */
+  return (int) (((day % 7) + 11) % 7);
+}
+
+/* Return the day number of ON in MONTH of YEAR, counted from
+   1970-01-01.  */
+static long long int
+zic_day (int year, int month, const struct zic_on *on)
+{
+  long long int d = days_from_civil (year, month, 1);
+  int len = (mon_yday[isleap (year)][month]
+	     - mon_yday[isleap (year)][month - 1]);
+
+  switch (on->kind)
+    {
+    case ZIC_ON_LAST:
+      d += len - 1;
+      return d - (zic_weekday (d) - on->wday + 7) % 7;
+    case ZIC_ON_GEQ:
+      d += on->day - 1;
+      return d + (on->wday - zic_weekday (d) + 7) % 7;
+    case ZIC_ON_LEQ:
+      d += on->day - 1;
+      return d - (zic_weekday (d) - on->wday + 7) % 7;
+    default:
+      return d + on->day - 1;
+    }
+}
+
+/* Return the UTC time of AT of type TYPE on DAY, where standard time
+   is STDOFF and SAVE is in effect.  */
+static int64_t
+zic_utc (long long int day, long int at, char type, long int stdoff,
+	 long int save)
+{
+  int64_t t = (int64_t) day * SECSPERDAY + at;
+
+  if (type == 's')
+    t -= stdoff;
+  else if (type == 'w')
+    t -= stdoff + save;
+  return t;
+}
+
+static int64_t
+zic_until (const struct zic_line *line, long int save)
+{
+  return zic_utc (zic_day (line->until_year, line->until_month,
+			   &line->until_on),
+		  line->until_at, line->until_type, line->stdoff, save);
+}
+
+/* Format the abbreviation of LINE with SAVE in effect, and the rule
+   letters LETTER, into BUF.  */
+static int
+zic_abbr (char *buf, const struct zic_line *line, long int save, int isdst,
+	  const char *letter)
+{
+  const char *f = line->format, *slash = strchr (f, '/');
+  size_t n = 0;
+
+  if (slash != NULL)
+    {
+      const char *start = isdst ? slash + 1 : f;
+      size_t len = isdst ? strlen (slash + 1) : (size_t) (slash - f);
+
+      if (len >= ZIC_ABBR)
+	return -1;
+      memcpy (buf, start, len);
+      buf[len] = '\0';
+      return 0;
+    }
+
+  for (; *f != '\0'; ++f)
+    {
+      char tmp[64];
+      const char *add = tmp;
+
+      if (*f != '%')
+	{
+	  tmp[0] = *f;
+	  tmp[1] = '\0';
+	}
+      else if (*++f == 's')
+	add = letter;
+      else if (*f == 'z')
+	{
+	  long int off = line->stdoff + save;
+	  long int a = labs (off);
+
+	  if (a % 60 != 0)
+	    sprintf (tmp, "%c%02ld%02ld%02ld", off < 0 ? '-' : '+',
+		     a / 3600, a / 60 % 60, a % 60);
+	  else if (a % 3600 != 0)
+	    sprintf (tmp, "%c%02ld%02ld", off < 0 ? '-' : '+', a / 3600,
+		     a / 60 % 60);
+	  else
+	    sprintf (tmp, "%c%02ld", off < 0 ? '-' : '+', a / 3600);
+	}
+      else if (*f == '%')
+	strcpy (tmp, "%");
+      else
+	return -1;
+
+      if (n + strlen (add) >= ZIC_ABBR)
+	return -1;
+      strcpy (buf + n, add);
+      n += strlen (add);
+    }
+  buf[n] = '\0';
+  return 0;
+}
+
+/* Return the index of the type (UTOFF, ISDST, ABBR) in OUT, adding it
+   if need be, or -1 if there is no room.  */
+static int
+zic_type (struct zic_out *out, long int utoff, int isdst, const char *abbr)
+{
+  size_t len = strlen (abbr), i;
+  size_t idx;
+
+  for (i = 0; i < out->typecnt; ++i)
+    if (out->types[i].utoff == utoff && out->types[i].isdst == isdst
+	&& strcmp (out->chars + out->types[i].abbrind, abbr) == 0)
+      return i;
+  if (out->typecnt == ZIC_TYPES)
+    return -1;
+
+  /* Share the characters of an abbreviation that ends the same.  */
+  for (idx = 0; idx < out->charcnt; idx += strlen (out->chars + idx) + 1)
+    {
+      size_t have = strlen (out->chars + idx);
+
+      if (have >= len && strcmp (out->chars + idx + have - len, abbr) == 0)
+	{
+	  idx += have - len;
+	  break;
+	}
+    }
+  if (idx >= out->charcnt)
+    {
+      if (out->charcnt + len + 1 > ZIC_CHARS)
+	return -1;
+      idx = out->charcnt;
+      memcpy (out->chars + idx, abbr, len + 1);
+      out->charcnt += len + 1;
+    }
+
+  out->types[out->typecnt].utoff = utoff;
+  out->types[out->typecnt].isdst = isdst;
+  out->types[out->typecnt].abbrind = idx;
+  return out->typecnt++;
+}
+
+/* Make room in OUT for one more transition.  */
+static int
+zic_reserve (struct zic_out *out)
+{
+  size_t max = out->max_times * 2 + 64;
+  int64_t *times;
+  unsigned char *idxs;
+
+  if (out->timecnt < out->max_times)
+    return 0;
+  times = realloc (out->times, max * sizeof (int64_t));
+  if (times == NULL)
+    return -1;
+  out->times = times;
+  idxs = realloc (out->idxs, max);
+  if (idxs == NULL)
+    return -1;
+  out->idxs = idxs;
+  out->max_times = max;
+  return 0;
+}
+
+/* Add a transition to TYPE at T.  */
+static int
+zic_addtt (struct zic_out *out, int64_t t, int type)
+{
+  if (type < 0 || zic_reserve (out) != 0)
+    return -1;
+  out->times[out->timecnt] = t;
+  out->idxs[out->timecnt++] = type;
+  return 0;
+}
+
+/* Work out the transitions of the NUM_LINES zone lines at LINES into
+   OUT for the years YEAR_LO to YEAR_HI, as zic does.  The transitions
+   are left unsorted.  If FOOTER, the TZ string covers the rules that
+   run on, and the last line stops when they take over.  */
+static int
+zic_outzone (const struct zic *z, const struct zic_line *lines,
+	     size_t num_lines, int year_lo, int year_hi, int footer,
+	     struct zic_out *out)
+{
+  const struct zic_rule **rules;
+  int64_t *temp, starttime = 0;
+  char *todo;
+  char startbuf[ZIC_ABBR], abbr[ZIC_ABBR];
+  size_t l, i, n;
+  int year, result = -1;
+
+  rules = malloc (z->num_rules * sizeof *rules + 1);
+  temp = malloc (z->num_rules * sizeof *temp + 1);
+  todo = malloc (z->num_rules + 1);
+  if (rules == NULL || temp == NULL || todo == NULL)
+    goto out;
+
+  out->defaulttype = -1;
+  out->lastatmax = -1;
+  out->endat = -1;
+  for (l = 0; l < num_lines; ++l)
+    {
+      const struct zic_line *line = &lines[l];
+      const struct zic_rule *prev = NULL;
+      long int stdoff = line->stdoff, save = 0, startoff = stdoff;
+      int usestart = l > 0, useuntil = l < num_lines - 1, type;
+
+      startbuf[0] = '\0';
+      if (line->rules == NULL)
+	{
+	  save = line->save;
+	  if (zic_abbr (startbuf, line, save, line->save_isdst, "") != 0)
+	    goto out;
+	  type = zic_type (out, stdoff + save, line->save_isdst, startbuf);
+	  if (usestart)
+	    {
+	      if (zic_addtt (out, starttime, type) != 0)
+		goto out;
+	      usestart = 0;
+	    }
+	  else
+	    out->defaulttype = type;
+	}
+      else
+	{
+	  for (i = n = 0; i < z->num_rules; ++i)
+	    if (strcmp (z->rules[i].name, line->rules) == 0)
+	      rules[n++] = &z->rules[i];
+
+	  for (year = year_lo; year <= year_hi; ++year)
+	    {
+	      if (useuntil && year > line->until_year)
+		break;
+	      for (i = 0; i < n; ++i)
+		{
+		  todo[i] = year >= rules[i]->from && year <= rules[i]->to;
+		  if (todo[i])
+		    temp[i] = zic_utc (zic_day (year, rules[i]->month,
+						&rules[i]->on),
+				       rules[i]->at, 'u', 0, 0);
+		}
+
+	      /* Take the rules of the year in the order they happen,
+		 which depends on the SAVE each leaves in effect.  */
+	      for (;;)
+		{
+		  const struct zic_rule *r;
+		  int64_t ktime = 0, untiltime = 0;
+		  ssize_t k = -1;
+
+		  if (useuntil)
+		    untiltime = zic_until (line, save);
+		  for (i = 0; i < n; ++i)
+		    if (todo[i])
+		      {
+			int64_t jtime = temp[i];
+
+			if (rules[i]->at_type != 'u')
+			  jtime -= stdoff;
+			if (rules[i]->at_type == 'w')
+			  jtime -= save;
+			if (k < 0 || jtime < ktime)
+			  {
+			    k = i;
+			    ktime = jtime;
+			  }
+			else if (jtime == ktime)
+			  {
+			    /* zic rejects two rules for the same instant.  */
+			    errno = EINVAL;
+			    goto out;
+			  }
+		      }
+		  if (k < 0)
+		    break;
+		  r = rules[k];
+		  todo[k] = 0;
+
+		  if (useuntil && ktime >= untiltime)
+		    {
+		      if (startbuf[0] == '\0' && stdoff + r->save == startoff
+			  && zic_abbr (startbuf, line, r->save, r->isdst,
+				       r->letter) != 0)
+			goto out;
+		      break;
+		    }
+		  save = r->save;
+		  if (usestart && ktime == starttime)
+		    usestart = 0;
+		  if (usestart)
+		    {
+		      /* Rules before the line starts only say what it
+			 starts in.  */
+		      if (ktime < starttime)
+			{
+			  startoff = stdoff + save;
+			  if (zic_abbr (startbuf, line, save, r->isdst,
+					r->letter) != 0)
+			    goto out;
+			  continue;
+			}
+		      if (startbuf[0] == '\0' && startoff == stdoff + save
+			  && zic_abbr (startbuf, line, save, r->isdst,
+				       r->letter) != 0)
+			goto out;
+		    }
+		  if (footer && !useuntil && prev != NULL
+		      && prev->to == ZIC_YEAR_MAX && r->to == ZIC_YEAR_MAX)
+		    break;
+		  if (zic_abbr (abbr, line, save, r->isdst, r->letter) != 0)
+		    goto out;
+		  type = zic_type (out, stdoff + save, r->isdst, abbr);
+		  if (out->defaulttype < 0 && !r->isdst)
+		    out->defaulttype = type;
+		  /* The TZ string starts from the last of these, so it is
+		     kept even if it changes nothing.  */
+		  if (r->to == ZIC_YEAR_MAX
+		      && (out->lastatmax < 0
+			  || ktime >= out->times[out->lastatmax]))
+		    out->lastatmax = out->timecnt;
+		  if (zic_addtt (out, ktime, type) != 0)
+		    goto out;
+		  prev = r;
+		}
+	    }
+	}
+
+      if (usestart)
+	{
+	  int isdst = startoff != stdoff;
+
+	  /* zic cannot name the time after the start either unless the
+	     format needs no rule letters.  */
+	  if (startbuf[0] == '\0'
+	      && (strstr (line->format, "%s") != NULL
+		  || zic_abbr (startbuf, line, save, isdst, "") != 0))
+	    goto out;
+	  type = zic_type (out, startoff, isdst, startbuf);
+	  if (out->defaulttype < 0 && !isdst)
+	    out->defaulttype = type;
+	  if (zic_addtt (out, starttime, type) != 0)
+	    goto out;
+	}
+      if (useuntil)
+	starttime = zic_until (line, save);
+    }
+  result = 0;
+
+ out:
+  free (rules);
+  free (temp);
+  free (todo);
+  return result;
+}
+
+static int
+zic_time_compare (const void *a, const void *b)
+{
+  const int64_t *x = a, *y = b;
+
+  return *x < *y ? -1 : *x > *y;
+}
+
+/* Sort the transitions of OUT and drop those that change nothing, or
+   that a later one overtakes on the wall clock, the way zic does.  */
+static int
+zic_optimize (struct zic_out *out)
+{
+  struct { int64_t at; size_t i; } *tt;
+  unsigned char *idxs;
+  size_t from, to = 0;
+
+  if (out->timecnt == 0)
+    return 0;
+  tt = malloc (out->timecnt * sizeof *tt);
+  idxs = malloc (out->timecnt);
+  if (tt == NULL || idxs == NULL)
+    {
+      free (tt);
+      free (idxs);
+      return -1;
+    }
+  for (from = 0; from < out->timecnt; ++from)
+    {
+      tt[from].at = out->times[from];
+      tt[from].i = from;
+    }
+  /* The index breaks ties, which keeps the sort stable.  */
+  qsort (tt, out->timecnt, sizeof *tt, zic_time_compare);
+  for (from = 0; from < out->timecnt; ++from)
+    idxs[from] = out->idxs[tt[from].i];
+
+  for (from = 0; from < out->timecnt; ++from)
+    {
+      const struct tzif_type *types = out->types;
+      int type = idxs[from];
+
+      if (to != 0
+	  && (tt[from].at + types[out->idxs[to - 1]].utoff
+	      <= (out->times[to - 1]
+		  + types[to == 1 ? 0 : out->idxs[to - 2]].utoff)))
+	{
+	  out->idxs[to - 1] = type;
+	  continue;
+	}
+      if (to == 0 || (ssize_t) tt[from].i == out->lastatmax
+	  || (ssize_t) tt[from].i == out->endat
+	  || types[out->idxs[to - 1]].utoff != types[type].utoff
+	  || types[out->idxs[to - 1]].isdst != types[type].isdst
+	  || types[out->idxs[to - 1]].abbrind != types[type].abbrind)
+	{
+	  out->times[to] = tt[from].at;
+	  out->idxs[to++] = type;
+	}
+    }
+  out->timecnt = to;
+  free (tt);
+  free (idxs);
+  return 0;
+}
+
+/* Append the POSIX form of abbreviation ABBR to BUF.  */
+static void
+zic_posix_abbr (char *buf, const char *abbr)
+{
+  const char *p;
+
+  for (p = abbr; isalpha ((unsigned char) *p); ++p)
+    continue;
+  if (*p == '\0' && p - abbr >= 3)
+    strcat (buf, abbr);
+  else
+    sprintf (buf + strlen (buf), "<%s>", abbr);
+}
+
+/* Append [-]h[:mm[:ss]] for SECS to BUF.  */
+static void
+zic_posix_hms (char *buf, long int secs)
+{
+  char *p = buf + strlen (buf);
+  long int a = labs (secs);
+
+  p += sprintf (p, "%s%ld", secs < 0 ? "-" : "", a / 3600);
+  if (a % 3600 != 0)
+    p += sprintf (p, ":%02ld", a / 60 % 60);
+  if (a % 60 != 0)
+    sprintf (p, ":%02ld", a % 60);
+}
+
+/* Append the POSIX form of the date and time of rule R to BUF, where
+   DST_SAVE is the save of daylight time.  Returns 0, 1 if it needs
+   version 3, or -1 if R cannot be written in POSIX form.  */
+static int
+zic_posix_rule (char *buf, const struct zic_rule *r, long int stdoff,
+		long int dst_save)
+{
+  char *p = buf + strlen (buf);
+  long int tod = r->at;
+  int wday = r->on.wday, week, shift = 0, v3 = 0;
+
+  switch (r->on.kind)
+    {
+    case ZIC_ON_DAY:
+      if (r->month == 2 && r->on.day == 29)
+	return -1;
+      sprintf (p, ",J%d", mon_yday[0][r->month - 1] + r->on.day);
+      break;
+    case ZIC_ON_LAST:
+      sprintf (p, ",M%d.5.%d", r->month, wday);
+      break;
+    case ZIC_ON_GEQ:
+      /* Sun>=N for N not 1, 8, 15 or 22 is a week day later than a
+	 week starts, which version 3 can say as hours past midnight.  */
+      shift = (r->on.day - 1) % 7;
+      week = 1 + (r->on.day - 1) / 7;
+      if (week > 5)
+	return -1;
+      sprintf (p, ",M%d.%d.%d", r->month, week, (wday - shift + 7) % 7);
+      break;
+    case ZIC_ON_LEQ:
+      if (r->on.day == (mon_yday[1][r->month] - mon_yday[1][r->month - 1]))
+	week = 5;
+      else
+	{
+	  shift = r->on.day % 7;
+	  week = r->on.day / 7;
+	  if (week == 0)
+	    return -1;
+	}
+      sprintf (p, ",M%d.%d.%d", r->month, week, (wday - shift + 7) % 7);
+      break;
+    }
+  if (shift != 0)
+    {
+      tod += shift * SECSPERDAY;
+      v3 = 1;
+    }
+
+  /* POSIX times are on the wall clock of the time before.  */
+  if (r->at_type == 'u')
+    tod += stdoff;
+  if (r->at_type != 'w' && !r->isdst)
+    tod += dst_save;
+  if (tod != 2 * 3600)
+    {
+      strcat (buf, "/");
+      zic_posix_hms (buf, tod);
+    }
+  if (tod < 0 || tod >= 168 * 3600)
+    v3 = tod < 0 ? 1 : -1;
+  return v3;
+}
+
+/* Return nonzero if rule A ends after rule B, or B is NULL.  */
+static int
+zic_rule_later (const struct zic_rule *a, const struct zic_rule *b)
+{
+  if (b == NULL)
+    return 1;
+  if (a->to != b->to)
+    return a->to > b->to;
+  if (a->to == ZIC_YEAR_MAX)
+    return 0;
+  if (a->month != b->month)
+    return a->month > b->month;
+  return a->on.day > b->on.day;
+}
+
+/* Write the TZ string for the time after the last transition of the
+   zone whose last line is LINE to BUF, which has room for the longest
+   possible.  Returns 0, 1 if it needs version 3, or -1 if there is
+   none and transitions must be written out instead.  */
+static int
+zic_footer (char *buf, const struct zic *z, const struct zic_line *line)
+{
+  const struct zic_rule *std = NULL, *dst = NULL;
+  struct zic_rule std_r, dst_r;
+  char abbr[ZIC_ABBR];
+  size_t i;
+  int v3, v;
+
+  buf[0] = '\0';
+  if (line->rules != NULL)
+    {
+      for (i = 0; i < z->num_rules; ++i)
+	{
+	  const struct zic_rule *r = &z->rules[i];
+
+	  if (strcmp (r->name, line->rules) != 0 || r->to != ZIC_YEAR_MAX)
+	    continue;
+	  if (r->isdst ? dst != NULL : std != NULL)
+	    return -1;
+	  if (r->isdst)
+	    dst = r;
+	  else
+	    std = r;
+	}
+
+      if (std == NULL && dst == NULL)
+	{
+	  /* No rule runs on, so the one that ended last says what the
+	     time is now.  Daylight time then is for ever, which the
+	     string says as a change from and back to it a year apart.  */
+	  const struct zic_rule *abbr_r = NULL;
+
+	  for (i = 0; i < z->num_rules; ++i)
+	    {
+	      const struct zic_rule *r = &z->rules[i];
+
+	      if (strcmp (r->name, line->rules) != 0)
+		continue;
+	      if (!r->isdst && zic_rule_later (r, abbr_r))
+		abbr_r = r;
+	      if (zic_rule_later (r, std))
+		std = r;
+	    }
+	  if (std != NULL && std->isdst)
+	    {
+	      memset (&dst_r, 0, sizeof dst_r);
+	      dst_r.month = 1;
+	      dst_r.on.kind = ZIC_ON_DAY;
+	      dst_r.on.day = 1;
+	      dst_r.at_type = 'w';
+	      dst_r.isdst = 1;
+	      dst_r.save = std->save;
+	      dst_r.letter = std->letter;
+	      std_r = dst_r;
+	      std_r.month = 12;
+	      std_r.on.day = 31;
+	      std_r.at = SECSPERDAY + std->save;
+	      std_r.isdst = 0;
+	      std_r.save = 0;
+	      std_r.letter = abbr_r != NULL ? abbr_r->letter : "";
+	      dst = &dst_r;
+	      std = &std_r;
+	    }
+	}
+    }
+  if (std == NULL && (line->rules != NULL || line->save_isdst))
+    return -1;
+
+  if (zic_abbr (abbr, line, std != NULL ? std->save : line->save, 0,
+		std != NULL ? std->letter : "") != 0)
+    return -1;
+  zic_posix_abbr (buf, abbr);
+  zic_posix_hms (buf, -(line->stdoff
+			+ (std != NULL ? std->save : line->save)));
+  if (dst == NULL)
+    return 0;
+
+  if (zic_abbr (abbr, line, dst->save, 1, dst->letter) != 0)
+    return -1;
+  zic_posix_abbr (buf, abbr);
+  if (dst->save != 3600)
+    zic_posix_hms (buf, -(line->stdoff + dst->save));
+  if ((v3 = zic_posix_rule (buf, dst, line->stdoff, dst->save)) < 0
+      || (v = zic_posix_rule (buf, std, line->stdoff, dst->save)) < 0)
+    return -1;
+  return v3 | v;
+}
+
+static void
+zic_years (int *lo, int *hi, int year)
+{
+  if (year < *lo)
+    *lo = year;
+  if (year > *hi)
+    *hi = year;
+}
+
+struct tz_zone *
+tz_zone_compile (const char *source, const char *name)
+{
+  struct zic z;
+  struct zic_out out;
+  struct tzif_data d;
+  struct tz_zone *zone = NULL;
+  const struct zic_line *lines = NULL;
+  char footer[4 * ZIC_ABBR + 128];
+  int year_lo = 1970, year_hi = 1970, v, links = 0, err = EINVAL;
+  int for_good;
+  size_t i, k, num_lines = 0;
+
+  if (source == NULL)
+    {
+      errno = EINVAL;
+      return NULL;
+    }
+  memset (&out, 0, sizeof out);
+  errno = 0;
+  if (zic_parse (&z, source) != 0)
+    goto out;
+
+  /* Find the zone, through links if need be.  */
+ again:
+  for (i = 0; i < z.num_lines; ++i)
+    if (z.lines[i].name != NULL
+	&& (name == NULL || strcmp (z.lines[i].name, name) == 0))
+      {
+	lines = &z.lines[i];
+	for (num_lines = 1;
+	     i + num_lines < z.num_lines && z.lines[i + num_lines].name == NULL;
+	     ++num_lines)
+	  continue;
+	break;
+      }
+  if (lines == NULL)
+    {
+      for (i = 0; i < z.num_links; ++i)
+	if (name != NULL && strcmp (z.links[i][1], name) == 0)
+	  break;
+      if (i == z.num_links || ++links > 16)
+	{
+	  err = ENOENT;
+	  goto out;
+	}
+      name = z.links[i][0];
+      goto again;
+    }
+
+  /* Rule transitions are made for every year the zone names, and the
+     TZ string takes over after them.  A zone of one line whose rules
+     all run from min to max is in them for good.  */
+  for_good = num_lines == 1;
+  for (i = 0; i < num_lines; ++i)
+    {
+      if (i < num_lines - 1)
+	{
+	  zic_years (&year_lo, &year_hi, lines[i].until_year);
+	}
+      if (lines[i].rules == NULL)
+	continue;
+      for (k = 0; k < z.num_rules; ++k)
+	if (strcmp (z.rules[k].name, lines[i].rules) == 0)
+	  break;
+      if (k == z.num_rules)
+	goto out;
+      for (; k < z.num_rules; ++k)
+	if (strcmp (z.rules[k].name, lines[i].rules) == 0)
+	  {
+	    const struct zic_rule *r = &z.rules[k];
+
+	    if (r->from != ZIC_YEAR_MIN)
+	      zic_years (&year_lo, &year_hi, r->from);
+	    if (r->to != ZIC_YEAR_MAX)
+	      zic_years (&year_lo, &year_hi, r->to);
+	    if (r->from != ZIC_YEAR_MIN || r->to != ZIC_YEAR_MAX)
+	      for_good = 0;
+	  }
+    }
+  /* Without a TZ string, write out enough years for the Gregorian
+     cycle to repeat; for a zone in its rules for good, one cycle from
+     1900 is enough.  */
+  v = zic_footer (footer, &z, &lines[num_lines - 1]);
+  if (v < 0 && for_good)
+    {
+      year_lo = 1900;
+      year_hi = 1900 + ZIC_YEARS_EXTEND;
+    }
+  else if (v < 0)
+    {
+      year_lo -= ZIC_YEARS_EXTEND;
+      year_hi += ZIC_YEARS_EXTEND;
+    }
+
+  if (zic_outzone (&z, lines, num_lines, year_lo, year_hi, v >= 0, &out)
+      != 0)
+    goto out;
+
+  /* Without a TZ string, the file must say that nothing changes up to
+     the end of those years: unless a transition is that late already,
+     one that changes nothing is added at the start of the year after
+     them, and kept.  */
+  if (v < 0)
+    {
+      size_t last = 0;
+
+      for (i = 1; i < out.timecnt; ++i)
+	if (out.times[i] > out.times[last])
+	  last = i;
+      if (out.timecnt == 0 || out.times[last] < year_start (year_hi - 1))
+	{
+	  if (zic_addtt (&out, year_start (year_hi + 1),
+			 out.timecnt > 0 ? out.idxs[last]
+			 : out.defaulttype > 0 ? out.defaulttype : 0) != 0)
+	    goto out;
+	  out.endat = out.timecnt - 1;
+	}
+    }
+  if (zic_optimize (&out) != 0)
+    goto out;
+
+  /* The type for before the first transition is type 0.  Readers take
+     the first standard time type for that, so a zone that starts out
+     in daylight time gets a transition at the beginning of time.  */
+  if (out.defaulttype > 0)
+    {
+      int def = out.defaulttype;
+      struct tzif_type tmp = out.types[0];
+
+      out.types[0] = out.types[def];
+      out.types[def] = tmp;
+      for (i = 0; i < out.timecnt; ++i)
+	if (out.idxs[i] == 0)
+	  out.idxs[i] = def;
+	else if (out.idxs[i] == def)
+	  out.idxs[i] = 0;
+    }
+  if (out.typecnt == 0)
+    goto out;
+  for (i = 1; i < out.typecnt; ++i)
+    if (!out.types[i].isdst)
+      break;
+  if (out.types[0].isdst && i < out.typecnt
+      && (out.timecnt == 0 || out.times[0] > ZIC_BIG_BANG))
+    {
+      if (zic_reserve (&out) != 0)
+	goto out;
+      memmove (out.times + 1, out.times, out.timecnt * sizeof (int64_t));
+      memmove (out.idxs + 1, out.idxs, out.timecnt);
+      out.times[0] = ZIC_BIG_BANG;
+      out.idxs[0] = 0;
+      ++out.timecnt;
+    }
+
+  memset (&d, 0, sizeof d);
+  d.timecnt = out.timecnt;
+  d.times = out.times;
+  d.idxs = out.idxs;
+  d.typecnt = out.typecnt;
+  d.types = out.types;
+  d.charcnt = out.charcnt;
+  d.chars = out.chars;
+  d.footer = v >= 0 ? footer : NULL;
+  d.version = v > 0 ? '3' : '2';
+  d.slim = 1;
+  zone = tzif_zone (&d);
+
+ out:
+  free (out.times);
+  free (out.idxs);
+  zic_free (&z);
+  /* Errors in SOURCE leave errno alone; memory running out does not.  */
+  if (zone == NULL && errno != ENOMEM)
+    errno = err;
+  return zone;
+}
+
+/* Writing zones.  A zone is written back out from its tables, and can
+   be cut down to what a window of time needs: the transitions in it,
+   the one before it that says what it starts in, and a TZ string that
+   agrees with the last type kept.  */
+
+/* Return nonzero if RULES hold type TYPE of ZONE from START through
+   END.  */
+static int
+rules_hold (const struct tz_zone *zone, int type, time_t start, time_t end)
+{
+  struct tz_rules *rules = zone->rules;
+  time_t begin, lo, hi;
+  int isdst;
+
+  if (rules == NULL)
+    return 0;
+  /* Intervals also end with the year.  The rules are the same every
+     year, so a type they keep for a whole year they keep for good.  */
+  for (begin = start;;)
+    {
+      isdst = rules_interval (rules, start, &lo, &hi);
+      if (isdst < 0
+	  || rules->offset[isdst] != zone_type_offset (zone, type)
+	  || isdst != zone_type_isdst (zone, type)
+	  || strcmp (rules->name[isdst],
+		     &zone->zone_names[zone_type_idx (zone, type)]) != 0)
+	return 0;
+      if (hi >= end || hi - begin > 366 * SECSPERDAY)
+	return 1;
+      start = hi + 1;
+    }
+}
+
+/* Return nonzero if ABBR can be written in a TZ string.  */
+static int
+abbr_is_posix (const char *abbr)
+{
+  const char *p;
+
+  for (p = abbr; *p != '\0'; ++p)
+    if (!isalnum ((unsigned char) *p) && *p != '+' && *p != '-')
+      return 0;
+  return p - abbr >= 3;
+}
+
+/* Write a TZ string to BUF that holds type TYPE of OUT for ever.  BUF
+   is left empty if TYPE cannot be said in one: daylight time all year
+   is written by zic as ",J1/0,J365/25", but readers that work the rules
+   out by UTC year, glibc's and ours among them, take the first hours of
+   each year west of UTC for standard time.  Without a string the last
+   type holds anyway.  */
+static void
+tzif_fixed_footer (char *buf, const struct zic_out *out, int type)
+{
+  const struct tzif_type *t = &out->types[type];
+  const char *abbr = out->chars + t->abbrind;
+
+  buf[0] = '\0';
+  if (t->isdst || !abbr_is_posix (abbr))
+    return;
+  zic_posix_abbr (buf, abbr);
+  zic_posix_hms (buf, -t->utoff);
+}
+
+void *
+tz_zone_image (struct tz_zone *zone, time_t from, time_t to, int flags,
+	       size_t *sizep)
+{
+  struct zic_out out;
+  struct tzif_data d;
+  struct tz_rules *rules;
+  unsigned char map[256], *image = NULL;
+  char footer[4 * ZIC_ABBR + 128];
+  size_t first, last, i, n;
+  int type, v3 = 0;
+
+  if (zone == NULL || sizep == NULL)
+    return NULL;
+  if (!(flags & TZ_WRITE_WINDOW))
+    {
+      from = TIME_T_MIN;
+      to = TIME_T_MAX;
+    }
+  /* A zone loaded for a window has nothing to say outside it.  */
+  if (zone->windowed)
+    {
+      if (from < zone->window_from)
+	from = zone->window_from;
+      if (to > zone->window_to)
+	to = zone->window_to;
+    }
+  if (from >= to)
+    return NULL;
+
+  /* Keep the transitions in [FROM, TO), and the last one before.  */
+  n = zone->num_transitions;
+  first = zone_transition_count (zone, from, 0);
+  if (first > 0)
+    --first;
+  last = zone_transition_count (zone, to, 1);
+  if (last < first)
+    last = first;
+
+  /* Past the original transitions, its TZ string still applies.  If the
+     window ends before them, the string has to agree with the type the
+     window ends in, or it is replaced below by one that holds that type
+     for good, or by none.
+     Slim output leaves the string the transitions it reproduces.  */
+  rules = zone->rules;
+  if (last < n
+      && !rules_hold (zone, last > first ? zone->type_idxs[last - 1]
+					 : zone->before_type,
+		      last > first ? zone_transition (zone, last - 1) : from,
+		      to - 1))
+    rules = NULL;
+  else if (flags & TZ_WRITE_SLIM)
+    while (last - first > 1
+	   && rules_hold (zone, zone->type_idxs[last - 2],
+			  zone_transition (zone, last - 2),
+			  zone_transition (zone, last - 1) - 1))
+      --last;
+
+  memset (&out, 0, sizeof out);
+  memset (&d, 0, sizeof d);
+  memset (map, 0xff, sizeof map);
+  out.times = malloc ((last - first) * sizeof (int64_t) + 1);
+  out.idxs = malloc (last - first + 1);
+  d.leap_times = malloc (zone->num_leaps * sizeof (int64_t) + 1);
+  d.leap_corrs = malloc (zone->num_leaps * sizeof (int32_t) + 1);
+  if (out.times == NULL || out.idxs == NULL || d.leap_times == NULL
+      || d.leap_corrs == NULL)
+    goto out;
+
+  /* Type 0 is what the window starts in.  */
+  type = (last > first && zone_transition (zone, first) <= from
+	  ? zone->type_idxs[first] : zone->before_type);
+  for (i = first; i <= last; ++i)
+    {
+      if (i > first)
+	type = zone->type_idxs[i - 1];
+      if (map[type] == 0xff)
+	{
+	  int t = zic_type (&out, zone_type_offset (zone, type),
+			    zone_type_isdst (zone, type),
+			    &zone->zone_names[zone_type_idx (zone, type)]);
+
+	  if (t < 0)
+	    goto out;
+	  map[type] = t;
+	}
+      if (i > first)
+	{
+	  out.times[out.timecnt] = zone_transition (zone, i - 1);
+	  out.idxs[out.timecnt++] = map[type];
+	}
+    }
+
+  d.footer = zone->tzspec;
+  if (rules == NULL && last < n)
+    {
+      tzif_fixed_footer (footer, &out, map[type]);
+      d.footer = footer;
+    }
+  if (rules != NULL && rules->has_dst)
+    for (i = 0; i < 2; ++i)
+      if (rules->rule[i].secs < 0 || rules->rule[i].secs > 24 * 3600)
+	v3 = 1;
+
+  for (i = 0; i < zone->num_leaps; ++i)
+    {
+      ((int64_t *) d.leap_times)[i] = zone_leap_transition (zone, i);
+      ((int32_t *) d.leap_corrs)[i] = zone_leap_change (zone, i);
+    }
+  d.leapcnt = zone->num_leaps;
+  d.timecnt = out.timecnt;
+  d.times = out.times;
+  d.idxs = out.idxs;
+  d.typecnt = out.typecnt;
+  d.types = out.types;
+  d.charcnt = out.charcnt;
+  d.chars = out.chars;
+  d.version = v3 ? '3' : '2';
+  d.slim = (flags & TZ_WRITE_SLIM) != 0;
+  image = tzif_image (&d, sizep);
+
+ out:
+  free (out.times);
+  free (out.idxs);
+  free ((void *) d.leap_times);
+  free ((void *) d.leap_corrs);
+  return image;
+}
+
+/* Compact zones.  A zone made by tz_zone_compact holds its own copy
+   of what lookups need, in the form of `struct tz_compact', and nothing
+   else: no file mapping, search layout or interned slot names.  */
+
+struct tz_zone *
+tz_zone_compact (struct tz_zone *zone)
+{
+  struct tz_zone *new;
+  struct tz_compact *c;
+  size_t n, types, blocks, leap_bytes, size, i, k;
+  time_t *base;
+  uint32_t *block_first, *delta;
+  int32_t *utoff;
+  unsigned char *p, *idxs, *isdst, *abbrind;
+
+  if (zone == NULL)
+    return NULL;
+  n = zone->num_transitions;
+  types = zone->num_types;
+  leap_bytes = zone->num_leaps * (zone->trans_width + 4);
+
+  /* Count the blocks; a zone without transitions still gets one.  */
+  blocks = 1;
+  for (i = 1, k = 0; i < n; ++i)
+    if ((uint64_t) zone_transition (zone, i)
+	- (uint64_t) zone_transition (zone, k) > UINT32_MAX)
+      {
+	++blocks;
+	k = i;
+      }
+
+  size = (sizeof (struct tz_compact)
+	  + blocks * sizeof (time_t)
+	  + (blocks + 1 + n) * sizeof (uint32_t)
+	  + types * sizeof (int32_t)
+	  + n + 2 * types + 2 * (n + 1)
+	  + zone->num_chars + leap_bytes + zone->num_isstd
+	  + zone->num_isgmt);
+  c = malloc (size);
+  new = calloc (1, sizeof (struct tz_zone));
+  if (c == NULL || new == NULL)
+    {
+      free (c);
+      free (new);
+      return NULL;
+    }
+
+  /* The widest members first, so that each array is aligned.  */
+  p = (unsigned char *) (c + 1);
+  base = (time_t *) p;
+  p += blocks * sizeof (time_t);
+  block_first = (uint32_t *) p;
+  p += (blocks + 1) * sizeof (uint32_t);
+  delta = (uint32_t *) p;
+  p += n * sizeof (uint32_t);
+  utoff = (int32_t *) p;
+  p += types * sizeof (int32_t);
+  idxs = p;
+  p += n;
+  isdst = p;
+  p += types;
+  abbrind = p;
+  p += types;
+  c->slot_abbrs = (unsigned char (*)[2]) p;
+  p += 2 * (n + 1);
+
+  base[0] = n > 0 ? zone_transition (zone, 0) : 0;
+  block_first[0] = 0;
+  for (i = 0, k = 0; i < n; ++i)
+    {
+      time_t t = zone_transition (zone, i);
+
+      if ((uint64_t) t - (uint64_t) base[k] > UINT32_MAX)
+	{
+	  base[++k] = t;
+	  block_first[k] = i;
+	}
+      delta[i] = (uint64_t) t - (uint64_t) base[k];
+      idxs[i] = zone->type_idxs[i];
+    }
+  block_first[blocks] = n;
+  for (i = 0; i < types; ++i)
+    {
+      utoff[i] = zone_type_offset (zone, i);
+      isdst[i] = zone_type_isdst (zone, i);
+      abbrind[i] = zone_type_idx (zone, i);
+    }
+
+  c->num_blocks = blocks;
+  c->base = base;
+  c->block_first = block_first;
+  c->delta = delta;
+  c->utoff = utoff;
+  c->isdst = isdst;
+  c->abbrind = abbrind;
+  c->size = size;
+
+  new->refcount = 1;
+  new->compact = c;
+  new->strings = strtab_new ();
+  new->trans_width = zone->trans_width;
+  new->num_transitions = n;
+  new->type_idxs = idxs;
+  new->num_types = types;
+  new->num_chars = zone->num_chars;
+  new->zone_names = memcpy (p, zone->zone_names, zone->num_chars);
+  p += zone->num_chars;
+  new->num_leaps = zone->num_leaps;
+  new->leaps = memcpy (p, zone->leaps, leap_bytes);
+  p += leap_bytes;
+  new->num_isstd = zone->num_isstd;
+  new->isstd = memcpy (p, zone->isstd, zone->num_isstd);
+  p += zone->num_isstd;
+  new->num_isgmt = zone->num_isgmt;
+  new->isgmt = memcpy (p, zone->isgmt, zone->num_isgmt);
+  new->windowed = zone->windowed;
+  new->window_from = zone->window_from;
+  new->window_to = zone->window_to;
+  if (zone->tzspec != NULL)
+    new->tzspec = tz_intern (new->strings, zone->tzspec);
+
+  if (zone_setup (new) != 0)
+    {
+      zone_free_tables (new);
+      free (new);
+      return NULL;
+    }
+  return new;
+}
+
+/* Direct indices.  The index itself is built by zone_index_build, on
+   the first lookup after it is asked for.  */
+
+int
+tz_zone_set_index (struct tz_zone *zone, int shift)
+{
+  struct tz_index *old;
+
+  if (zone == NULL
+      || (shift != 0 && (shift < TZ_INDEX_SHIFT_MIN
+			 || shift > TZ_INDEX_SHIFT_MAX)))
+    return -1;
+
+  pthread_mutex_lock (&zone_index_lock);
+  old = zone->index;
+  if (old == NULL || old == &index_wanted || zone->index_shift != shift)
+    {
+      struct tz_index *index = shift != 0 ? &index_wanted : NULL, **p;
+
+      /* One dropped before for this shift is still good.  */
+      for (p = &zone->index_old; shift != 0 && *p != NULL; p = &(*p)->prev)
+	if ((*p)->shift == shift)
+	  {
+	    index = *p;
+	    *p = index->prev;
+	    index->prev = NULL;
+	    break;
+	  }
+      zone->index_shift = shift;
+      __atomic_store_n (&zone->index, index, __ATOMIC_RELEASE);
+      /* Readers may still be using the old one.  */
+      if (old != NULL && old != &index_wanted)
+	{
+	  old->prev = zone->index_old;
+	  zone->index_old = old;
+	}
+    }
+  pthread_mutex_unlock (&zone_index_lock);
+  return 0;
+}
+
+void
+tz_memory_stats (struct tz_zone *zone, struct tz_memory_stats *stats)
+{
+  const struct tz_index *index;
+  const struct tz_rule_years *years;
+  size_t n;
+
+  memset (stats, 0, sizeof *stats);
+  if (zone == NULL)
+    return;
+  n = zone->num_transitions;
+
+  stats->zone = sizeof (struct tz_zone);
+  if (zone->map_heap)
+    stats->mapped = zone->map_size;
+  else if (zone->map != NULL)
+    {
+      size_t page = sysconf (_SC_PAGESIZE);
+
+      stats->mapped = (zone->map_size + page - 1) / page * page;
+    }
+  if (zone->eytz != NULL)
+    stats->search = ((n + 1) * (sizeof (time_t) + sizeof (uint32_t))
+		     + 63) & ~(size_t) 63;
+  if (zone->tznames != NULL)
+    stats->names = (n + 1) * sizeof (*zone->tznames);
+  if (zone->compact != NULL)
+    stats->compact = zone->compact->size;
+  pthread_mutex_lock (&zone_index_lock);
+  if (zone->index != &index_wanted && zone->index != NULL)
+    stats->index += (sizeof (struct tz_index)
+		     + (zone->index->num_buckets
+			* sizeof (struct tz_index_bucket)));
+  for (index = zone->index_old; index != NULL; index = index->prev)
+    stats->index += (sizeof (struct tz_index)
+		     + index->num_buckets * sizeof (struct tz_index_bucket));
+  pthread_mutex_unlock (&zone_index_lock);
+  if (zone->rules != NULL)
+    {
+      stats->rules = sizeof (struct tz_rules);
+      for (years = __atomic_load_n (&zone->rules->years, __ATOMIC_ACQUIRE);
+	   years != NULL; years = years->prev)
+	stats->rules += (sizeof (struct tz_rule_years)
+			 + years->count * sizeof (years->change[0]));
+    }
+  if (zone->strings != NULL)
+    stats->strings = (sizeof (struct tz_strtab)
+		      + zone->strings->stats.arena_bytes
+		      + (zone->strings->stats.index_slots
+			 * sizeof (struct tz_strent)));
+  stats->total = (stats->zone + stats->mapped + stats->search
+		  + stats->names + stats->compact + stats->index
+		  + stats->rules + stats->strings);
+}
+
+#ifdef TZ_STATS
+static pthread_key_t tz_counters_key;
+static pthread_once_t tz_counters_once = PTHREAD_ONCE_INIT;
+
+/* Add the N counters at FROM to those at TO.  */
+static void
+counters_add (uint64_t *to, const uint64_t *from, size_t n)
+{
+  size_t i;
+
+  for (i = 0; i < n; ++i)
+    to[i] += __atomic_load_n (&from[i], __ATOMIC_RELAXED);
+}
+
+#define COUNTERS_N (sizeof (struct tz_counters) / sizeof (uint64_t))
+
+static void
+counters_unregister (void *arg)
+{
+  struct tz_thread_counters *t = arg, **p;
+
+  pthread_mutex_lock (&tz_counters_lock);
+  for (p = &tz_counting_threads; *p != NULL; p = &(*p)->next)
+    if (*p == t)
+      {
+	*p = t->next;
+	break;
+      }
+  counters_add ((uint64_t *) &tz_exited_counters,
+		(const uint64_t *) &t->counters, COUNTERS_N);
+  pthread_mutex_unlock (&tz_counters_lock);
+}
+
+static void
+counters_key_init (void)
+{
+  pthread_key_create (&tz_counters_key, counters_unregister);
+}
+
+static __attribute__ ((noinline)) void
+counters_register (struct tz_thread_counters *t)
+{
+  pthread_once (&tz_counters_once, counters_key_init);
+  pthread_mutex_lock (&tz_counters_lock);
+  t->next = tz_counting_threads;
+  tz_counting_threads = t;
+  pthread_mutex_unlock (&tz_counters_lock);
+  pthread_setspecific (tz_counters_key, t);
+  t->registered = 1;
+}
+#endif
+
+int
+tz_counters (struct tz_zone *zone, struct tz_counters *counters)
+{
+#ifdef TZ_STATS
+  struct tz_thread_counters *t;
+
+  memset (counters, 0, sizeof *counters);
+  if (zone != NULL)
+    {
+      counters_add ((uint64_t *) counters,
+		    (const uint64_t *) &zone->counters, COUNTERS_N);
+      return 0;
+    }
+  pthread_mutex_lock (&tz_counters_lock);
+  counters_add ((uint64_t *) counters,
+		(const uint64_t *) &tz_exited_counters, COUNTERS_N);
+  for (t = tz_counting_threads; t != NULL; t = t->next)
+    counters_add ((uint64_t *) counters,
+		  (const uint64_t *) &t->counters, COUNTERS_N);
+  pthread_mutex_unlock (&tz_counters_lock);
+  return 0;
+#else
+  memset (counters, 0, sizeof *counters);
+  return -1;
+#endif
+}
+
+/* Look TIMER up in ZONE, leaving leap seconds aside, and store the
+   result in *RESULT and the standard and daylight names in effect in
+   NAME.  Returns the TZ rules used, or NULL if a transition of the file
+   applied.  Nothing but the outputs is written, so any number of
+   threads can look up at once.  */
+static const struct tz_rules *
+zone_lookup (const struct tz_zone *zone, time_t timer,
+	     struct tz_lookup *result, char *name[2])
+{
+  const size_t num_transitions = zone->num_transitions;
+  size_t i;
+
+  if (__builtin_expect (num_transitions == 0
+			|| timer < zone_transition (zone, 0), 0))
+    {
+      /* TIMER is before any transition (or there are no transitions).  */
+      TZ_COUNT (zone, lookup_before);
+      TZ_PROBE (lookup_before, zone, timer);
+      name[0] = zone_slot_name (zone, 0, 0);
+      name[1] = zone_slot_name (zone, 0, 1);
+      i = zone->before_type;
+    }
+  else if (__builtin_expect (timer >= zone_transition (zone,
+						       num_transitions - 1),
+			     0))
+    {
+      struct tz_rules *rules = zone->rules;
+      time_t lo, hi;
+      int isdst;
+
+      if (__builtin_expect (rules == NULL, 0))
+	{
+	use_last:
+	  TZ_COUNT (zone, lookup_last);
+	  TZ_PROBE (lookup_last, zone, timer);
+	  i = num_transitions;
+	  goto found;
+	}
+
+      /* Use the rules from the TZ string, compiled when the zone was
+	 loaded.  If TIMER is out of their range do not use them.  */
+      isdst = rules_interval (rules, timer, &lo, &hi);
+      if (__builtin_expect (isdst < 0, 0))
+	goto use_last;
+      TZ_COUNT (zone, lookup_rules);
+      TZ_PROBE (lookup_rules, zone, timer, isdst);
+
+      /* If tzspec comes from posixrules loaded by __tzfile_default,
+	 the STD and DST zone names are the ones user requested in TZ
+	 envvar.  */
+      if (__builtin_expect (zone->zone_names == zone->extra, 0))
+	{
+	  assert (zone->num_types == 2);
+	  name[0] = zone->extra;
+	  name[1] = &zone->extra[strlen (zone->extra) + 1];
+	}
+      else
+	{
+	  name[0] = rules->name[0];
+	  name[1] = rules->name[1];
+	}
+
+      result->isdst = isdst;
+      result->gmtoff = rules->offset[isdst];
+      result->abbr = name[isdst];
+      return rules;
+    }
+  else
+    {
+      /* Find the first transition after TIMER, and
+	 then pick the type of the transition before it.  */
+      i = zone_search (zone, timer);
+      TZ_COUNT (zone, lookup_search);
+      TZ_PROBE (lookup_search, zone, timer, i);
+
+    found:
+      /* assert (timer >= zone_transition (zone, i - 1)
+	 && (i == num_transitions || timer < zone_transition (zone, i))); */
+      name[0] = zone_slot_name (zone, i, 0);
+      name[1] = zone_slot_name (zone, i, 1);
+      i = zone->type_idxs[i - 1];
+    }
+
+  result->isdst = zone_type_isdst (zone, i);
+  assert (strcmp (&zone->zone_names[zone_type_idx (zone, i)],
+		  name[result->isdst]) == 0);
+  result->gmtoff = zone_type_offset (zone, i);
+  result->abbr = name[result->isdst];
+  return NULL;
+}
+
+/* Compute for the process zone: zone_lookup, and then install what it
+   found in __tzname, __daylight and __timezone.  */
+static void
+tzfile_compute_zone (const struct tz_zone *zone, time_t timer,
+		     int use_localtime, long int *leap_correct, int *leap_hit,
+		     struct tm *tp)
+{
+  const size_t num_leaps = zone->num_leaps;
+  register size_t i;
+
+  if (use_localtime)
+    {
+      const struct tz_rules *rules;
+      struct tz_lookup result;
+      /* The names are chosen by zone_lookup and only then installed as
+	 __tzname, which other threads may be writing at the same
+	 time.  */
+      char *name[2];
+
+      rules = zone_lookup (zone, timer, &result, name);
+      if (rules != NULL)
+	{
+	  __daylight = rules->offset[0] != rules->offset[1];
+	  __timezone = -rules->offset[0];
+
+	  /* Names from the TZ envvar must outlive the zone.  */
+	  if (__builtin_expect (zone->zone_names == zone->extra, 0))
+	    {
+	      name[0] = __tzstring (name[0]);
+	      name[1] = __tzstring (name[1]);
+	    }
+	}
+      else
+	{
+	  __daylight = zone->rule_stdoff != zone->rule_dstoff;
+	  __timezone = -zone->rule_stdoff;
+	}
+      __tzname[0] = name[0];
+      __tzname[1] = name[1];
+
+      tp->tm_isdst = result.isdst;
+      tp->tm_zone = name[result.isdst];
+      tp->tm_gmtoff = result.gmtoff;
+
+      if (rules != NULL)
+	{
+	  *leap_correct = 0L;
+	  *leap_hit = 0;
+	  return;
+	}
+    }
+
+  *leap_correct = 0L;
+  *leap_hit = 0;
+
+  /* Find the last leap second correction transition time before TIMER.  */
+  if (num_leaps == 0)
+    return;
+  i = zone_leap_search (zone, timer);
+  TZ_COUNT (zone, lookup_leap);
+  TZ_PROBE (lookup_leap, zone, timer, i);
+  if (i-- == 0)
+    return;
+
+  /* Apply its correction.  */
+  *leap_correct = zone_leap_change (zone, i);
+
+  /* Exactly at the transition time.  */
+  if (timer == zone_leap_transition (zone, i) &&
+      (i == 0 ? zone_leap_change (zone, i) > 0
+       : zone_leap_change (zone, i) > zone_leap_change (zone, i - 1)))
+    {
+      *leap_hit = 1;
+      while (i > 0
+	     && (zone_leap_transition (zone, i)
+		 == zone_leap_transition (zone, i - 1) + 1)
+	     && zone_leap_change (zone, i) == zone_leap_change (zone, i - 1) + 1)
+	{
+	  ++*leap_hit;
+	  --i;
+	}
+    }
+}
+
+void
+__tzfile_compute (time_t timer, int use_localtime,
+		  long int *leap_correct, int *leap_hit,
+		  struct tm *tp)
+{
+  struct tz_reader *r = reader_enter ();
+
+  tzfile_compute_zone (__atomic_load_n (&tzfile_zone, __ATOMIC_ACQUIRE),
+		       timer, use_localtime, leap_correct, leap_hit, tp);
+  reader_exit (r);
+}
+
+/* Return nonzero if ZONE can answer lookups at TIMER: it was loaded
+   whole, or TIMER is in its window.  */
+static inline int
+zone_covers (const struct tz_zone *zone, time_t timer)
+{
+  return (!zone->windowed
+	  || (timer >= zone->window_from && timer < zone->window_to));
+}
+
+/* Likewise for all N times in IN.  */
+static int
+zone_covers_all (const struct tz_zone *zone, const time_t *in, size_t n)
+{
+  time_t lo = TIME_T_MAX, hi = TIME_T_MIN;
+  size_t k;
+
+  if (!zone->windowed || n == 0)
+    return 1;
+  for (k = 0; k < n; ++k)
+    {
+      lo = in[k] < lo ? in[k] : lo;
+      hi = in[k] > hi ? in[k] : hi;
+    }
+  return zone_covers (zone, lo) && zone_covers (zone, hi);
+}
+
+int
+tz_zone_lookup (const struct tz_zone *zone, time_t timer,
+		struct tz_lookup *result)
+{
+  char *name[2];
+
+  if (zone == NULL)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+  if (!zone_covers (zone, timer))
+    {
+      errno = ERANGE;
+      return -1;
+    }
+  zone_lookup (zone, timer, result, name);
+  return 0;
+}
+
+int
+tz_zone_compute (struct tz_zone *zone, time_t timer, struct tm *tp)
+{
+  struct tz_lookup result;
+
+  if (tz_zone_lookup (zone, timer, &result) != 0)
+    return -1;
+  tp->tm_isdst = result.isdst;
+  tp->tm_gmtoff = result.gmtoff;
+  tp->tm_zone = result.abbr;
+  return 0;
+}
+
+/* Batch conversion.  Timestamps in a log batch are mostly close to
+   each other, so rather than searching the transitions for each one we
+   find the interval containing the first, then measure how many of the
+   following timestamps fall in the same interval, several at a time
+   where the CPU allows it.  */
+
+/* Return the type of ZONE in effect at TIMER, and store the first and
+   last instants for which that stays true in *LO and *HI.  Returns -1
+   if TIMER is past the last transition and the zone's TZ rules apply
+   instead.  */
+static int
+zone_interval (const struct tz_zone *zone, time_t timer,
+	       time_t *lo, time_t *hi)
+{
+  size_t n = zone->num_transitions;
+  size_t i;
+
+  if (n == 0 || timer < zone_transition (zone, 0))
+    {
+      *lo = TIME_T_MIN;
+      *hi = n == 0 ? TIME_T_MAX : zone_transition (zone, 0) - 1;
+      return zone->before_type;
+    }
+
+  if (timer >= zone_transition (zone, n - 1))
+    {
+      if (zone->rules != NULL)
+	return -1;
+      *lo = zone_transition (zone, n - 1);
+      *hi = TIME_T_MAX;
+      return zone->type_idxs[n - 1];
+    }
+
+  i = zone_search (zone, timer);
+  *lo = zone_transition (zone, i - 1);
+  *hi = zone_transition (zone, i) - 1;
+  return zone->type_idxs[i - 1];
+}
+
+typedef size_t (*batch_run_fn) (const time_t *, size_t, time_t, time_t);
+
+/* Return the number of leading elements of IN[0..N) in [LO, HI].  */
+static size_t
+batch_run_scalar (const time_t *in, size_t n, time_t lo, time_t hi)
+{
+  size_t k = 0;
+
+  while (k < n && in[k] >= lo && in[k] <= hi)
+    ++k;
+  return k;
+}
+
+#if defined __x86_64__
+/* SSE2 has no 64-bit compare.  Compare the high halves signed and the
+   low halves unsigned, and combine.  */
+static inline __m128i
+cmpgt_epi64_sse2 (__m128i a, __m128i b)
+{
+  const __m128i bias = _mm_set_epi32 (0, INT_MIN, 0, INT_MIN);
+  __m128i gt = _mm_cmpgt_epi32 (_mm_xor_si128 (a, bias),
+				_mm_xor_si128 (b, bias));
+  __m128i eq = _mm_cmpeq_epi32 (a, b);
+  __m128i gt_lo = _mm_shuffle_epi32 (gt, _MM_SHUFFLE (2, 2, 0, 0));
+  __m128i gt_hi = _mm_shuffle_epi32 (gt, _MM_SHUFFLE (3, 3, 1, 1));
+  __m128i eq_hi = _mm_shuffle_epi32 (eq, _MM_SHUFFLE (3, 3, 1, 1));
+
+  return _mm_or_si128 (gt_hi, _mm_and_si128 (eq_hi, gt_lo));
+}
+
+static size_t
+batch_run_sse2 (const time_t *in, size_t n, time_t lo, time_t hi)
+{
+  const __m128i vlo = _mm_set1_epi64x (lo);
+  const __m128i vhi = _mm_set1_epi64x (hi);
+  size_t k = 0;
+
+  for (; k + 2 <= n; k += 2)
+    {
+      __m128i t = _mm_loadu_si128 ((const __m128i *) &in[k]);
+      __m128i out = _mm_or_si128 (cmpgt_epi64_sse2 (vlo, t),
+				  cmpgt_epi64_sse2 (t, vhi));
+      int mask = _mm_movemask_pd (_mm_castsi128_pd (out));
+
+      if (mask != 0)
+	return k + __builtin_ctz (mask);
+    }
+  return k + batch_run_scalar (in + k, n - k, lo, hi);
+}
+
+__attribute__ ((target ("avx2")))
+static size_t
+batch_run_avx2 (const time_t *in, size_t n, time_t lo, time_t hi)
+{
+  const __m256i vlo = _mm256_set1_epi64x (lo);
+  const __m256i vhi = _mm256_set1_epi64x (hi);
+  size_t k = 0;
+
+  for (; k + 4 <= n; k += 4)
+    {
+      __m256i t = _mm256_loadu_si256 ((const __m256i *) &in[k]);
+      __m256i out = _mm256_or_si256 (_mm256_cmpgt_epi64 (vlo, t),
+				     _mm256_cmpgt_epi64 (t, vhi));
+      int mask = _mm256_movemask_pd (_mm256_castsi256_pd (out));
+
+      if (mask != 0)
+	return k + __builtin_ctz (mask);
+    }
+  return k + batch_run_sse2 (in + k, n - k, lo, hi);
+}
+#endif
+
+static batch_run_fn batch_run = batch_run_scalar;
+static pthread_once_t batch_run_once = PTHREAD_ONCE_INIT;
+
+static void
+batch_run_select (void)
+{
+#if defined __x86_64__
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2"))
+    batch_run = batch_run_avx2;
+  else
+    batch_run = batch_run_sse2;
+#endif
+}
+
+int
+tz_compute_batch (struct tz_zone *zone, const time_t *in, size_t n,
+		  int32_t *gmtoff_out, uint8_t *isdst_out, uint8_t *type_out)
+{
+  size_t k, run;
+
+  if (zone == NULL)
+    return -1;
+  if (!zone_covers_all (zone, in, n))
+    {
+      errno = ERANGE;
+      return -1;
+    }
+
+  pthread_once (&batch_run_once, batch_run_select);
+
+  for (k = 0; k < n; k += run)
+    {
+      time_t lo, hi;
+      int type = zone_interval (zone, in[k], &lo, &hi);
+
+      if (type < 0)
+	{
+	  /* Governed by the TZ string.  */
+	  int isdst = rules_interval (zone->rules, in[k], &lo, &hi);
+
+	  if (isdst < 0)
+	    {
+	      /* Out of the rules' range; take the single-value path.  */
+	      struct tz_lookup lookup;
+
+	      if (tz_zone_lookup (zone, in[k], &lookup) != 0)
+		return -1;
+	      if (gmtoff_out != NULL)
+		gmtoff_out[k] = lookup.gmtoff;
+	      if (isdst_out != NULL)
+		isdst_out[k] = lookup.isdst;
+	      if (type_out != NULL)
+		type_out[k] = zone->type_idxs[zone->num_transitions - 1];
+	      run = 1;
+	      continue;
+	    }
+
+	  /* The rules only apply from the last transition on.  */
+	  if (lo < zone_transition (zone, zone->num_transitions - 1))
+	    lo = zone_transition (zone, zone->num_transitions - 1);
+	  run = batch_run (in + k, n - k, lo, hi);
+	  if (gmtoff_out != NULL)
+	    {
+	      int32_t gmtoff = zone->rules->offset[isdst];
+	      size_t j;
+
+	      for (j = 0; j < run; ++j)
+		gmtoff_out[k + j] = gmtoff;
+	    }
+	  if (isdst_out != NULL)
+	    memset (isdst_out + k, isdst, run);
+	  if (type_out != NULL)
+	    memset (type_out + k, TZ_TYPE_RULE, run);
+	  continue;
+	}
+
+      run = batch_run (in + k, n - k, lo, hi);
+      if (gmtoff_out != NULL)
+	{
+	  int32_t gmtoff = zone_type_offset (zone, type);
+	  size_t j;
+
+	  for (j = 0; j < run; ++j)
+	    gmtoff_out[k + j] = gmtoff;
+	}
+      if (isdst_out != NULL)
+	memset (isdst_out + k, zone_type_isdst (zone, type), run);
+      if (type_out != NULL)
+	memset (type_out + k, type, run);
+    }
+  return 0;
+}
+
+/* Calendar breakdown.  A local time is UTC plus the offset of the
+   zone; its date comes from the day count by the inverse of
+   days_from_civil, and the time of day from the remainder.  */
+
+/* Store the proleptic Gregorian date DAYS after 1970-01-01 in *YEAR,
+   *MON (0-based) and *MDAY, and return the day of the year.  */
+static inline int
+civil_from_days (long long int days, long long int *year, int *mon,
+		 int *mday)
+{
+  long long int z = days + 719468;
+  long long int era = (z >= 0 ? z : z - 146096) / 146097;
+  unsigned int doe = (unsigned int) (z - era * 146097);
+  unsigned int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  unsigned int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  unsigned int mp = (5 * doy + 2) / 153;
+
+  /* The year of YOE starts on March 1, so January and February belong
+     to the calendar year after it.  */
+  *year = era * 400 + yoe + (mp >= 10);
+  *mon = mp < 10 ? mp + 2 : mp - 10;
+  *mday = doy - (153 * mp + 2) / 5 + 1;
+  return mp < 10 ? doy + 59 + isleap (yoe) : doy - 306;
+}
+
+int
+tz_breakdown (time_t timer, long int gmtoff, struct tm *tp)
+{
+  long long int local, days, year;
+  int sod;
+
+  if (__builtin_add_overflow ((long long int) timer, gmtoff, &local))
+    goto overflow;
+  days = local / SECSPERDAY;
+  sod = local % SECSPERDAY;
+  if (sod < 0)
+    {
+      sod += SECSPERDAY;
+      --days;
+    }
+  tp->tm_yday = civil_from_days (days, &year, &tp->tm_mon, &tp->tm_mday);
+  if (year < (long long int) INT_MIN + TM_YEAR_BASE
+      || year > (long long int) INT_MAX + TM_YEAR_BASE)
+    goto overflow;
+  tp->tm_year = year - TM_YEAR_BASE;
+  tp->tm_wday = ((days + EPOCH_WDAY) % DAYSPERWEEK + DAYSPERWEEK)
+		% DAYSPERWEEK;
+  tp->tm_hour = sod / SECSPERHOUR;
+  tp->tm_min = sod / SECSPERMIN % MINSPERHOUR;
+  tp->tm_sec = sod % SECSPERMIN;
+  tp->tm_gmtoff = gmtoff;
+  return 0;
+
+ overflow:
+  errno = EOVERFLOW;
+  return -1;
+}
+
+/* The batch form works on blocks of BREAKDOWN_BLOCK times in 32-bit
+   unsigned arithmetic, which the compiler vectorizes.  Local times
+   have BREAKDOWN_BIAS, eleven 400-year cycles, added so that they are
+   not negative; those that are then below BREAKDOWN_SPAN, which takes
+   in the years from -2430 to 6280, have a day count of less than 2^22
+   and are handled there.  Others go through tz_breakdown.  */
+#define BREAKDOWN_BLOCK 64
+#define BREAKDOWN_BIAS_DAYS (11 * 146097)
+#define BREAKDOWN_BIAS ((uint64_t) BREAKDOWN_BIAS_DAYS * SECSPERDAY)
+#define BREAKDOWN_SPAN (UINT64_C (1) << 38)
+
+/* Break down the first N of the BREAKDOWN_BLOCK times in IN into OUT.
+   The vectorized loops always run over the whole block, so that their
+   trip count is fixed.  On x86-64 there is a copy for AVX2 as well,
+   picked when the program is loaded.  */
+#if defined __x86_64__
+__attribute__ ((target_clones ("avx2", "default")))
+#endif
+static int
+breakdown_block (const time_t *in, const int32_t *gmtoff, size_t n,
+		 struct tm *out)
+{
+  uint32_t days[BREAKDOWN_BLOCK], sod[BREAKDOWN_BLOCK];
+  uint32_t year[BREAKDOWN_BLOCK], mon[BREAKDOWN_BLOCK];
+  uint32_t mday[BREAKDOWN_BLOCK], yday[BREAKDOWN_BLOCK];
+  uint32_t wday[BREAKDOWN_BLOCK], hour[BREAKDOWN_BLOCK];
+  uint32_t min[BREAKDOWN_BLOCK], sec[BREAKDOWN_BLOCK];
+  unsigned char ok[BREAKDOWN_BLOCK];
+  size_t i;
+  int result = 0;
+
+  /* SECSPERDAY is 675 << 7, so the day count and the second of the day
+     come from a 32-bit division once the low 7 bits are set aside.  */
+  for (i = 0; i < BREAKDOWN_BLOCK; ++i)
+    {
+      uint64_t u = ((uint64_t) in[i] + (uint64_t) (int64_t) gmtoff[i]
+		    + BREAKDOWN_BIAS);
+      uint32_t x = (uint32_t) (u >> 7);
+      uint32_t d = x / 675;
+
+      ok[i] = (uint32_t) (u >> 32) < (uint32_t) (BREAKDOWN_SPAN >> 32);
+      days[i] = d;
+      sod[i] = ((x - d * 675) << 7) | (uint32_t) (u & 127);
+    }
+
+  /* As civil_from_days, with the year biased by 4400.  */
+  for (i = 0; i < BREAKDOWN_BLOCK; ++i)
+    {
+      uint32_t z = days[i] + 719468;
+      uint32_t era = z / 146097;
+      uint32_t doe = z - era * 146097;
+      uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+      uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+      uint32_t mp = (5 * doy + 2) / 153;
+      uint32_t leap = (yoe % 4 == 0) & ((yoe % 100 != 0) | (yoe == 0));
+
+      year[i] = era * 400 + yoe + (mp >= 10);
+      mon[i] = mp < 10 ? mp + 2 : mp - 10;
+      mday[i] = doy - (153 * mp + 2) / 5 + 1;
+      yday[i] = mp < 10 ? doy + 59 + leap : doy - 306;
+      wday[i] = ((days[i] + EPOCH_WDAY + DAYSPERWEEK
+		  - BREAKDOWN_BIAS_DAYS % DAYSPERWEEK) % DAYSPERWEEK);
+      hour[i] = sod[i] / SECSPERHOUR;
+      min[i] = sod[i] / SECSPERMIN % MINSPERHOUR;
+      sec[i] = sod[i] % SECSPERMIN;
+    }
+
+  for (i = 0; i < n; ++i)
+    {
+      struct tm *tp = &out[i];
+
+      if (__builtin_expect (!ok[i], 0))
+	{
+	  if (tz_breakdown (in[i], gmtoff[i], tp) != 0)
+	    result = -1;
+	  continue;
+	}
+      tp->tm_year = (int) year[i] - 4400 - TM_YEAR_BASE;
+      tp->tm_mon = mon[i];
+      tp->tm_mday = mday[i];
+      tp->tm_yday = yday[i];
+      tp->tm_wday = wday[i];
+      tp->tm_hour = hour[i];
+      tp->tm_min = min[i];
+      tp->tm_sec = sec[i];
+      tp->tm_gmtoff = gmtoff[i];
+    }
+  return result;
+}
+
+int
+tz_breakdown_batch (const time_t *in, const int32_t *gmtoff, size_t n,
+		    struct tm *out)
+{
+  time_t last_in[BREAKDOWN_BLOCK];
+  int32_t last_gmtoff[BREAKDOWN_BLOCK];
+  size_t k, m;
+  int result = 0;
+
+  for (k = 0; k + BREAKDOWN_BLOCK <= n; k += BREAKDOWN_BLOCK)
+    if (breakdown_block (in + k, gmtoff + k, BREAKDOWN_BLOCK, out + k) != 0)
+      result = -1;
+
+  /* The last block is padded out with the epoch.  */
+  m = n - k;
+  if (m > 0)
+    {
+      memset (last_in, 0, sizeof last_in);
+      memset (last_gmtoff, 0, sizeof last_gmtoff);
+      memcpy (last_in, in + k, m * sizeof (time_t));
+      memcpy (last_gmtoff, gmtoff + k, m * sizeof (int32_t));
+      if (breakdown_block (last_in, last_gmtoff, m, out + k) != 0)
+	result = -1;
+    }
+  return result;
+}
+
+int
+tz_zone_localtime (struct tz_zone *zone, time_t timer, struct tm *tp)
+{
+  if (tz_zone_compute (zone, timer, tp) != 0)
+    return -1;
+  return tz_breakdown (timer, tp->tm_gmtoff, tp);
+}
+
+/* Formatting timestamps.  A formatter keeps the text of the last
+   stamp it wrote in two parts: the prefix up to the seconds, which
+   holds until the local minute changes, and the suffix after them
+   (offset, abbreviation, or the year for ctime style), which holds
+   while the zone's offset does.  A stamp in the same minute as the
+   last is then two copies and two digits.  A new minute of the same
+   local day rewrites the hour and minute digits; only a new day, or a
+   new offset, goes back to the zone and the calendar.  */
+
+#define MINSPERDAY (MINSPERHOUR * HOURSPERDAY)
+
+/* Room for the prefix, whose year has at most 11 characters, and for
+   the suffix within TZ_FORMAT_MAX, after the seconds, a fraction of
+   up to seven characters and the null byte.  */
+#define FORMAT_PREFIX_MAX 32
+#define FORMAT_SUFFIX_MAX (TZ_FORMAT_MAX - FORMAT_PREFIX_MAX - 10)
+
+struct tz_format
+{
+  struct tz_zone *zone;
+  int style, flags;
+
+  /* The offset and abbreviation in effect from OFF_LO to OFF_HI.  */
+  time_t off_lo, off_hi;
+  long int gmtoff;
+  const char *abbr;
+
+  /* The local day and minute, counted from the epoch, that PREFIX and
+     SUFFIX were written for, if VALID.  */
+  int valid;
+  long long int day, minute;
+
+  char prefix[FORMAT_PREFIX_MAX];
+  size_t prefix_len;
+  char suffix[FORMAT_SUFFIX_MAX];
+  size_t suffix_len;
+};
+
+static const char format_wday[][4] =
+  { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+static const char format_mon[][4] =
+  {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+  };
+
+static inline char *
+format_2 (char *p, unsigned int v)
+{
+  p[0] = '0' + v / 10;
+  p[1] = '0' + v % 10;
+  return p + 2;
+}
+
+/* Write YEAR with at least four digits.  */
+static char *
+format_year (char *p, int year)
+{
+  if (year >= 0 && year <= 9999)
+    {
+      p = format_2 (p, year / 100);
+      return format_2 (p, year % 100);
+    }
+  return p + sprintf (p, "%04d", year);
+}
+
+/* Write the prefix of FMT for the local time *TP, up to and including
+   the colon before the seconds.  */
+static void
+format_prefix (struct tz_format *fmt, const struct tm *tp)
+{
+  char *p = fmt->prefix;
+
+  if (fmt->style == TZ_FORMAT_CTIME)
+    {
+      memcpy (p, format_wday[tp->tm_wday], 3);
+      p[3] = ' ';
+      memcpy (p + 4, format_mon[tp->tm_mon], 3);
+      p[7] = ' ';
+      p = format_2 (p + 8, tp->tm_mday);
+      if (p[-2] == '0')
+	p[-2] = ' ';
+      *p++ = ' ';
+    }
+  else
+    {
+      p = format_year (p, tp->tm_year + TM_YEAR_BASE);
+      *p++ = '-';
+      p = format_2 (p, tp->tm_mon + 1);
+      *p++ = '-';
+      p = format_2 (p, tp->tm_mday);
+      *p++ = 'T';
+    }
+  p = format_2 (p, tp->tm_hour);
+  *p++ = ':';
+  p = format_2 (p, tp->tm_min);
+  *p++ = ':';
+  fmt->prefix_len = p - fmt->prefix;
+}
+
+/* Write a space and ABBR to P, cut to leave ROOM bytes before END.  */
+static char *
+format_abbr (char *p, const char *end, size_t room, const char *abbr)
+{
+  size_t len = strnlen (abbr, end - p - room - 1);
+
+  *p++ = ' ';
+  return mempcpy (p, abbr, len);
+}
+
+/* Write the suffix of FMT for the local time *TP.  */
+static void
+format_suffix (struct tz_format *fmt, const struct tm *tp)
+{
+  char *p = fmt->suffix;
+  const char *end = fmt->suffix + sizeof fmt->suffix;
+
+  if (fmt->style == TZ_FORMAT_CTIME)
+    {
+      if (fmt->flags & TZ_FORMAT_ABBR)
+	p = format_abbr (p, end, 12, fmt->abbr);
+      *p++ = ' ';
+      p = format_year (p, tp->tm_year + TM_YEAR_BASE);
+    }
+  else
+    {
+      long int off = fmt->gmtoff;
+
+      *p++ = off < 0 ? '-' : '+';
+      if (off < 0)
+	off = -off;
+      p = format_2 (p, off / SECSPERHOUR);
+      if (fmt->style == TZ_FORMAT_RFC3339)
+	*p++ = ':';
+      p = format_2 (p, off / SECSPERMIN % MINSPERHOUR);
+      /* Only with TZ_FORMAT_OFFSET_SEC can there be seconds left; see
+	 format_offset.  */
+      if (off % SECSPERMIN != 0)
+	{
+	  if (fmt->style == TZ_FORMAT_RFC3339)
+	    *p++ = ':';
+	  p = format_2 (p, off % SECSPERMIN);
+	}
+      if (fmt->flags & TZ_FORMAT_ABBR)
+	p = format_abbr (p, end, 0, fmt->abbr);
+    }
+  fmt->suffix_len = p - fmt->suffix;
+}
+
+/* Find the offset and abbreviation of the zone of FMT at TIMER, and
+   how long they hold.  Returns 0 on success, -1 if TIMER is outside
+   the zone's range.  */
+static int
+format_offset (struct tz_format *fmt, time_t timer)
+{
+  struct tz_zone *zone = fmt->zone;
+  struct tm tm;
+  time_t lo, hi;
+  int type;
+
+  if (tz_zone_compute (zone, timer, &tm) != 0)
+    return -1;
+
+  type = zone_interval (zone, timer, &lo, &hi);
+  if (type < 0)
+    {
+      size_t n = zone->num_transitions;
+
+      if (rules_interval (zone->rules, timer, &lo, &hi) < 0)
+	lo = hi = timer;
+      else if (n > 0 && lo < zone_transition (zone, n - 1))
+	lo = zone_transition (zone, n - 1);
+    }
+  if (zone->windowed)
+    {
+      if (lo < zone->window_from)
+	lo = zone->window_from;
+      if (hi > zone->window_to - 1)
+	hi = zone->window_to - 1;
+    }
+
+  fmt->off_lo = lo;
+  fmt->off_hi = hi;
+  fmt->gmtoff = tm.tm_gmtoff;
+  /* Neither standard has offsets with seconds, so those of local mean
+     time are rounded to whole minutes unless asked for.  The stamp is
+     written with the rounded offset, wall clock included, so that it
+     still names TIMER.  */
+  if (fmt->style != TZ_FORMAT_CTIME && !(fmt->flags & TZ_FORMAT_OFFSET_SEC))
+    fmt->gmtoff = ((fmt->gmtoff
+		    + (fmt->gmtoff < 0 ? -SECSPERMIN : SECSPERMIN) / 2)
+		   / SECSPERMIN * SECSPERMIN);
+  fmt->abbr = tm.tm_zone;
+  fmt->valid = 0;
+  return 0;
+}
+
+struct tz_format *
+tz_format_new (struct tz_zone *zone, int style, int flags)
+{
+  struct tz_format *fmt;
+
+  if (zone == NULL
+      || (style != TZ_FORMAT_ISO8601 && style != TZ_FORMAT_RFC3339
+	  && style != TZ_FORMAT_CTIME)
+      || (flags & ~(TZ_FORMAT_MSEC | TZ_FORMAT_USEC | TZ_FORMAT_ABBR
+		    | TZ_FORMAT_OFFSET_SEC)) != 0
+      || (flags & TZ_FORMAT_MSEC && flags & TZ_FORMAT_USEC))
+    {
+      errno = EINVAL;
+      return NULL;
+    }
+  fmt = calloc (1, sizeof (struct tz_format));
+  if (fmt == NULL)
+    return NULL;
+
+  pthread_mutex_lock (&zone_table_lock);
+  ++zone->refcount;
+  pthread_mutex_unlock (&zone_table_lock);
+  fmt->zone = zone;
+  fmt->style = style;
+  fmt->flags = flags;
+  /* Nothing cached yet.  */
+  fmt->off_lo = TIME_T_MAX;
+  fmt->off_hi = TIME_T_MIN;
+  return fmt;
+}
+
+void
+tz_format_free (struct tz_format *fmt)
+{
+  if (fmt == NULL)
+    return;
+  tz_zone_close (fmt->zone);
+  free (fmt);
+}
+
+/* Write the stamp for TIMER and NSEC to P, which has room for
+   TZ_FORMAT_MAX bytes, and return its length, without the
+   terminating null byte, or -1.  */
+static int
+format_one (struct tz_format *fmt, time_t timer, long int nsec, char *p)
+{
+  long long int local, minute, day;
+  char *start = p;
+  int sec;
+
+  if (__builtin_expect (timer < fmt->off_lo || timer > fmt->off_hi, 0)
+      && format_offset (fmt, timer) != 0)
+    return -1;
+
+  /* TIMER is in the zone's range, so only its very ends can overflow.  */
+  if (__builtin_add_overflow ((long long int) timer, fmt->gmtoff, &local))
+    {
+      errno = EOVERFLOW;
+      return -1;
+    }
+  minute = local / SECSPERMIN;
+  sec = local % SECSPERMIN;
+  if (sec < 0)
+    {
+      sec += SECSPERMIN;
+      --minute;
+    }
+
+  if (__builtin_expect (minute != fmt->minute || !fmt->valid, 0))
+    {
+      day = minute / MINSPERDAY - (minute % MINSPERDAY < 0);
+      if (fmt->valid && day == fmt->day)
+	{
+	  /* Only the hour and minute change.  */
+	  int m = minute - day * MINSPERDAY;
+	  char *q = fmt->prefix + fmt->prefix_len - 6;
+
+	  format_2 (q, m / MINSPERHOUR);
+	  format_2 (q + 3, m % MINSPERHOUR);
+	}
+      else
+	{
+	  struct tm tm;
+
+	  if (tz_breakdown (timer, fmt->gmtoff, &tm) != 0)
+	    return -1;
+	  format_prefix (fmt, &tm);
+	  format_suffix (fmt, &tm);
+	  fmt->valid = 1;
+	  fmt->day = day;
+	}
+      fmt->minute = minute;
+    }
+
+  memcpy (p, fmt->prefix, fmt->prefix_len);
+  p = format_2 (p + fmt->prefix_len, sec);
+  if (fmt->flags & (TZ_FORMAT_MSEC | TZ_FORMAT_USEC))
+    {
+      unsigned int frac, digits, i;
+
+      if (fmt->flags & TZ_FORMAT_MSEC)
+	{
+	  frac = nsec / 1000000;
+	  digits = 3;
+	}
+      else
+	{
+	  frac = nsec / 1000;
+	  digits = 6;
+	}
+      *p++ = '.';
+      for (i = digits; i-- > 0; frac /= 10)
+	p[i] = '0' + frac % 10;
+      p += digits;
+    }
+  memcpy (p, fmt->suffix, fmt->suffix_len);
+  p += fmt->suffix_len;
+  *p = '\0';
+  return p - start;
+}
+
+int
+tz_format (struct tz_format *fmt, time_t timer, long int nsec, char *buf,
+	   size_t size)
+{
+  char tmp[TZ_FORMAT_MAX];
+  int len;
+
+  if (fmt == NULL || nsec < 0 || nsec >= 1000000000)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+  if (size >= TZ_FORMAT_MAX)
+    return format_one (fmt, timer, nsec, buf);
+
+  len = format_one (fmt, timer, nsec, tmp);
+  if (len < 0)
+    return -1;
+  if ((size_t) len >= size)
+    {
+      errno = ERANGE;
+      return -1;
+    }
+  memcpy (buf, tmp, len + 1);
+  return len;
+}
+
+int
+tz_format_batch (struct tz_format *fmt, const time_t *in, const long int *nsec,
+		 size_t n, char *buf, size_t size, size_t *ends)
+{
+  size_t k, used = 0;
+
+  if (fmt == NULL)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+  for (k = 0; k < n; ++k)
+    {
+      long int ns = nsec != NULL ? nsec[k] : 0;
+      int len;
+
+      if (ns < 0 || ns >= 1000000000)
+	{
+	  errno = EINVAL;
+	  return -1;
+	}
+      if (size - used >= TZ_FORMAT_MAX)
+	len = format_one (fmt, in[k], ns, buf + used);
+      else
+	len = tz_format (fmt, in[k], ns, buf + used, size - used);
+      if (len < 0)
+	return -1;
+      used += len + 1;
+      if (ends != NULL)
+	ends[k] = used;
+    }
+  return 0;
+}
+
+/* UTC and TAI.  A zone's leap second table (from right/) splits time
+   into intervals over which TAI - UTC is constant, and batches are
+   converted a run of such an interval at a time, as above.  Leap
+   records hold their transitions in the zone's own scale, which counts
+   leap seconds and so is TAI - TAI_BASE_OFFSET; in POSIX seconds
+   record I starts at its transition less the correction before it.  */
+
+#define TAI_BASE_OFFSET 10
+
+/* Start of leap record I of ZONE in POSIX seconds if POSIX, else in
+   the zone's own scale.  */
+static time_t
+zone_leap_start (const struct tz_zone *zone, size_t i, int posix)
+{
+  time_t t = zone_leap_transition (zone, i);
+
+  if (posix && i > 0)
+    t -= zone_leap_change (zone, i - 1);
+  return t;
+}
+
+/* Convert the N times in IN to OUT: POSIX seconds to TAI if TO_TAI,
+   else TAI to POSIX seconds.  */
+static void
+leap_batch (const struct tz_zone *zone, const time_t *in, size_t n,
+	    time_t *out, int to_tai)
+{
+  /* Without TO_TAI, look TAI up as the zone's scale shifted by BASE.  */
+  const time_t base = to_tai ? 0 : TAI_BASE_OFFSET;
+  size_t k, run;
+
+  pthread_once (&batch_run_once, batch_run_select);
+
+  for (k = 0; k < n; k += run)
+    {
+      size_t i, lo_i, hi_i, j;
+      time_t lo, hi;
+      long int corr, delta;
+
+      /* Find the records in effect with a binary search in POSIX
+	 seconds, or in the zone's scale.  */
+      lo_i = 0;
+      hi_i = zone->num_leaps;
+      while (lo_i < hi_i)
+	{
+	  i = (lo_i + hi_i) / 2;
+	  if (zone_leap_start (zone, i, to_tai) + base <= in[k])
+	    lo_i = i + 1;
+	  else
+	    hi_i = i;
+	}
+      i = lo_i;
+
+      lo = i == 0 ? TIME_T_MIN : zone_leap_start (zone, i - 1, to_tai) + base;
+      hi = (i == zone->num_leaps ? TIME_T_MAX
+	    : zone_leap_start (zone, i, to_tai) + base - 1);
+      corr = i == 0 ? 0 : zone_leap_change (zone, i - 1);
+      delta = to_tai ? TAI_BASE_OFFSET + corr : -TAI_BASE_OFFSET - corr;
+
+      run = batch_run (in + k, n - k, lo, hi);
+      for (j = 0; j < run; ++j)
+	out[k + j] = in[k + j] + delta;
+    }
+}
+
+int
+tz_utc_to_tai (struct tz_zone *zone, const time_t *in, size_t n,
+	       time_t *out)
+{
+  if (zone == NULL)
+    return -1;
+  leap_batch (zone, in, n, out, 1);
+  return 0;
+}
+
+int
+tz_tai_to_utc (struct tz_zone *zone, const time_t *in, size_t n,
+	       time_t *out)
+{
+  if (zone == NULL)
+    return -1;
+  leap_batch (zone, in, n, out, 0);
+  return 0;
+}
+
+/* Local to UTC conversion.  A wall time L can only belong to the
+   intervals of constant offset that meet [L - W, L + W], W being the
+   zone's largest offset.  We walk those in time order; every interval
+   whose local span holds L gives one candidate instant, in increasing
+   order.  None means L is in a gap, more than one that it is in a
+   fold.  */
+
+/* Return the UTC offset of ZONE at TIMER, and store the first and last
+   instants with that offset in *LO and *HI, the TZ rules included.  */
+static long int
+zone_offset_interval (const struct tz_zone *zone, time_t timer,
+		      time_t *lo, time_t *hi)
+{
+  int type = zone_interval (zone, timer, lo, hi);
+  int isdst;
+
+  if (type >= 0)
+    return zone_type_offset (zone, type);
+
+  isdst = rules_interval (zone->rules, timer, lo, hi);
+  if (isdst < 0)
+    {
+      /* Past the rules' range the last type stays in effect.  */
+      *lo = timer;
+      *hi = TIME_T_MAX;
+      return zone_type_offset (zone,
+			       zone->type_idxs[zone->num_transitions - 1]);
+    }
+  if (*lo < zone_transition (zone, zone->num_transitions - 1))
+    *lo = zone_transition (zone, zone->num_transitions - 1);
+  return zone->rules->offset[isdst];
+}
+
+/* The intervals met by the last window looked at, which the next
+   conversion of a sorted batch mostly reuses.  */
+#define LOCAL_WINDOW_MAX 16
+
+struct local_interval
+{
+  time_t lo, hi;
+  long int offset;
+};
+
+struct local_window
+{
+  struct local_interval ival[LOCAL_WINDOW_MAX];
+  size_t n;
+};
+
+static time_t
+time_add_sat (time_t t, long int d)
+{
+  time_t r;
+
+  if (__builtin_add_overflow (t, d, &r))
+    return d < 0 ? TIME_T_MIN : TIME_T_MAX;
+  return r;
+}
+
+/* Return nonzero if ZONE can resolve the wall time LOCAL, that is if
+   every instant it might name, and the intervals around them, are in
+   the zone's window.  */
+static int
+zone_covers_local (const struct tz_zone *zone, time_t local)
+{
+  return (zone_covers (zone, time_add_sat (local, -zone->max_offset - 1))
+	  && zone_covers (zone, time_add_sat (local, zone->max_offset + 1)));
+}
+
+/* Resolve LOCAL in ZONE as tz_local_to_utc does, using and updating the
+   intervals cached in WIN.  */
+static int
+local_resolve (const struct tz_zone *zone, struct local_window *win,
+	       time_t local, int gap, int fold, time_t *utcp)
+{
+  time_t from = time_add_sat (local, -zone->max_offset - 1);
+  time_t to = time_add_sat (local, zone->max_offset + 1);
+  time_t first = 0, last = 0;
+  long int before = 0, after = 0;
+  struct local_interval cur;
+  size_t count = 0, k, drop;
+  int in_gap = 0;
+
+  /* Forget the intervals that end before the window, and start over if
+     the window begins before the cached ones (unsorted input).  */
+  for (drop = 0; drop < win->n && win->ival[drop].hi < from; ++drop)
+    continue;
+  if (drop > 0)
+    {
+      win->n -= drop;
+      memmove (win->ival, win->ival + drop,
+	       win->n * sizeof (struct local_interval));
+    }
+  if (win->n > 0 && win->ival[0].lo > from)
+    win->n = 0;
+
+  for (k = 0; ; ++k)
+    {
+      time_t u;
+
+      if (k < win->n)
+	cur = win->ival[k];
+      else
+	{
+	  time_t t = k == 0 ? from : cur.hi + 1;
+
+	  cur.offset = zone_offset_interval (zone, t, &cur.lo, &cur.hi);
+	  if (win->n < LOCAL_WINDOW_MAX)
+	    win->ival[win->n++] = cur;
+	}
+
+      if (!__builtin_sub_overflow (local, cur.offset, &u))
+	{
+	  if (u >= cur.lo && u <= cur.hi)
+	    {
+	      if (count++ == 0)
+		first = u;
+	      last = u;
+	    }
+	  else if (u < cur.lo && count == 0 && k > 0 && !in_gap)
+	    {
+	      /* LOCAL fell between the previous interval and this one.  */
+	      in_gap = 1;
+	      after = cur.offset;
+	    }
+	}
+      if (!in_gap)
+	before = cur.offset;
+
+      if (cur.hi >= to || cur.hi == TIME_T_MAX)
+	break;
+    }
+
+  if (count == 1)
+    {
+      *utcp = first;
+      return TZ_LOCAL_UNIQUE;
+    }
+  if (count > 1)
+    {
+      if (fold == TZ_LOCAL_REJECT)
+	return -1;
+      *utcp = fold == TZ_LOCAL_LATER ? last : first;
+      return TZ_LOCAL_FOLD;
+    }
+
+  /* In a gap: apply the offsets on either side of it.  A forward change
+     makes AFTER the larger, and so LOCAL - AFTER the earlier.  */
+  if (gap == TZ_LOCAL_REJECT || !in_gap)
+    return -1;
+  first = time_add_sat (local, -(after > before ? after : before));
+  last = time_add_sat (local, -(after > before ? before : after));
+  *utcp = gap == TZ_LOCAL_LATER ? last : first;
+  return TZ_LOCAL_GAP;
+}
+
+int
+tz_local_to_utc (struct tz_zone *zone, time_t local, int gap, int fold,
+		 time_t *utcp)
+{
+  struct local_window win;
+
+  if (zone == NULL)
+    return -1;
+  if (!zone_covers_local (zone, local))
+    {
+      errno = ERANGE;
+      return -1;
+    }
+  win.n = 0;
+  return local_resolve (zone, &win, local, gap, fold, utcp);
+}
+
+int
+tz_local_to_utc_batch (struct tz_zone *zone, const time_t *local, size_t n,
+		       int gap, int fold, time_t *utc_out,
+		       uint8_t *status_out)
+{
+  struct local_window win;
+  size_t k;
+
+  if (zone == NULL)
+    return -1;
+  if (zone->windowed)
+    for (k = 0; k < n; ++k)
+      if (!zone_covers_local (zone, local[k]))
+	{
+	  errno = ERANGE;
+	  return -1;
+	}
+
+  /* One pass: in sorted input each window overlaps the last, so the
+     intervals are found once and then only moved past.  */
+  win.n = 0;
+  for (k = 0; k < n; ++k)
+    {
+      int r = local_resolve (zone, &win, local[k], gap, fold, &utc_out[k]);
+
+      if (status_out != NULL)
+	status_out[k] = r < 0 ? TZ_LOCAL_REJECTED : r;
+    }
+  return 0;
+}
@@ -0,0 +1,498 @@
+#ifndef TZZONE_H
+
+#define TZZONE_H
+
+/*
+** Reentrant interface to the tzfile reader.
+**
+** Each zone is an opaque, reference-counted object.  Zones are kept in
+** a registry keyed by the name they were opened with, so opening a name
+** that is already loaded returns the existing object without touching
+** the disk.  A name whose file holds the same zone as a name already
+** loaded, such as a link or a backward name, shares its object too.
+** Any number of zones can be open at once.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+struct tz_zone;
+
+/*
+** Return the zone for NAME, loading it from TZDIR if it is not already
+** loaded.  NAME follows the TZ conventions of __tzfile_read: NULL means
+** TZDEFAULT, relative names are looked up under TZDIR.  Returns NULL
+** if the zone cannot be loaded.  Each successful call must be paired
+** with a call to tz_zone_close.
+*/
+extern struct tz_zone *tz_zone_open (const char *name);
+
+/*
+** Load the zone NAME from TZDIR, as tz_zone_open does, for lookups in
+** [FROM, TO) only.  Just the transitions in that range and the one
+** before it are used, which saves memory and load time for zones with
+** long histories; the leap second table is kept whole.  Lookups outside
+** the range fail with errno set to ERANGE.  The zone is not entered in
+** the registry.  Returns NULL if FROM is not before TO or the zone
+** cannot be loaded.  Release the zone with tz_zone_close.
+*/
+extern struct tz_zone *tz_zone_open_window (const char *name, time_t from,
+					    time_t to);
+
+/*
+** Open the N zones NAMES at once, as tz_zone_open does, to warm the
+** registry at startup.  The files are read and parsed by a pool of
+** threads, and each zone can be opened from other threads as soon as
+** it is loaded.  ZONES[i] is set to the zone for NAMES[i], or to NULL
+** if it cannot be loaded; release each with tz_zone_close.  If ZONES is
+** NULL the references are kept instead, and the zones stay loaded for
+** as long as the process runs.  Returns the number of zones loaded.
+*/
+extern size_t tz_preload (const char *const names[], size_t n,
+			  struct tz_zone *zones[]);
+
+/*
+** The local time type tz_zone_lookup finds.
+*/
+struct tz_lookup
+{
+  long int gmtoff;		/* Seconds east of UTC.  */
+  int isdst;			/* Nonzero in daylight saving time.  */
+  const char *abbr;		/* Abbreviation, such as "CEST"; valid
+				   while the zone is open.  */
+};
+
+/*
+** Store in *RESULT the local time type in effect at TIMER in ZONE.
+** Leap second corrections are not applied.  Only *RESULT is written:
+** not __tzname, __daylight or __timezone, which only the localtime
+** family updates, and not the zone, beyond building its direct index
+** once if tz_zone_set_index asked for one.  Any number of threads can
+** look up in the same zone at once without sharing a written cache
+** line (the counters of a TZ_STATS build aside).  Returns 0 on success,
+** -1 with errno set to EINVAL if ZONE is NULL or to ERANGE if TIMER is
+** outside the range it was loaded for.
+*/
+extern int tz_zone_lookup (const struct tz_zone *zone, time_t timer,
+			   struct tz_lookup *result);
+
+/*
+** Fill in tm_isdst, tm_gmtoff and tm_zone of *TP for TIMER in ZONE, as
+** tz_zone_lookup finds them.  Returns 0 on success, -1 as
+** tz_zone_lookup fails.
+*/
+extern int tz_zone_compute (struct tz_zone *zone, time_t timer,
+			    struct tm *tp);
+
+/*
+** Type index reported by tz_compute_batch for instants after the last
+** transition, whose offset comes from the zone's POSIX TZ string.
+*/
+#define TZ_TYPE_RULE	255
+
+/*
+** Convert the N timestamps in IN for ZONE.  For each IN[i] the UTC
+** offset, DST flag and local time type index are stored in
+** GMTOFF_OUT[i], ISDST_OUT[i] and TYPE_OUT[i]; any output may be NULL.
+** The results are the same as calling tz_zone_compute on each element
+** in turn.  Runs of timestamps in the same interval are handled
+** together, so batches that are roughly in time order convert fastest.
+** Returns 0 on success, -1 if ZONE is NULL or any of IN is outside the
+** range it was loaded for; nothing is converted then.
+*/
+extern int tz_compute_batch (struct tz_zone *zone, const time_t *in,
+			     size_t n, int32_t *gmtoff_out,
+			     uint8_t *isdst_out, uint8_t *type_out);
+
+/*
+** Break TIMER down into *TP as the civil time GMTOFF seconds east of
+** UTC, in the proleptic Gregorian calendar: tm_sec through tm_yday,
+** and tm_gmtoff.  tm_isdst and tm_zone are left alone.  This is what
+** gmtime_r gives for TIMER + GMTOFF, without a lock or a zone.
+** Returns 0 on success, -1 with errno set to EOVERFLOW if the year
+** does not fit in tm_year.
+*/
+extern int tz_breakdown (time_t timer, long int gmtoff, struct tm *tp);
+
+/*
+** Break each of the N timestamps in IN down into OUT[i] with the
+** offset GMTOFF[i], as tz_breakdown does; GMTOFF is as tz_compute_batch
+** stores it.  Times within some 4000 years of 1970 are done in blocks,
+** with arithmetic the compiler vectorizes.  Returns 0 on success, -1
+** if any of the years overflowed; the other times are still broken
+** down.
+*/
+extern int tz_breakdown_batch (const time_t *in, const int32_t *gmtoff,
+			       size_t n, struct tm *out);
+
+/*
+** Fill in all of *TP for TIMER in ZONE, as localtime_r does but without
+** leap second corrections: tz_zone_compute, then tz_breakdown.  Returns
+** 0 on success, -1 if either fails.
+*/
+extern int tz_zone_localtime (struct tz_zone *zone, time_t timer,
+			      struct tm *tp);
+
+/*
+** Timestamp formatters, for stamping log lines.  A formatter writes
+** times in one zone in one of these styles:
+*/
+struct tz_format;
+
+#define TZ_FORMAT_ISO8601	0	/* 2024-03-10T14:05:09+0100 */
+#define TZ_FORMAT_RFC3339	1	/* 2024-03-10T14:05:09+01:00 */
+#define TZ_FORMAT_CTIME		2	/* Sun Mar 10 14:05:09 2024 */
+
+/*
+** with any of these flags:
+*/
+#define TZ_FORMAT_MSEC		1	/* milliseconds: 14:05:09.123 */
+#define TZ_FORMAT_USEC		2	/* microseconds: 14:05:09.123456 */
+#define TZ_FORMAT_ABBR		4	/* the zone abbreviation: " CET"
+					   at the end, or before the year
+					   in ctime style */
+#define TZ_FORMAT_OFFSET_SEC	8	/* the seconds of an offset that has
+					   them: +00:09:21, which neither
+					   standard allows */
+
+/*
+** Offsets are otherwise rounded to the nearest minute, and the time of
+** day is written for the rounded offset, so that the stamp still names
+** the same instant: local mean time in Amsterdam, +00:19:32, is written
+** +00:20, and its noon 12:00:28+00:20.  An offset that rounds to zero
+** is written +00:00.  The ctime style writes no offset, and the local
+** time as it is.
+*/
+
+/*
+** Bytes any stamp needs, with its null byte.  Longer abbreviations are
+** cut to fit.
+*/
+#define TZ_FORMAT_MAX		80
+
+/*
+** Return a formatter for times in ZONE in STYLE with FLAGS.  It keeps
+** the date, time and offset of the last stamp, and only works out again
+** what has changed since, so that stamps in time order cost little
+** more than copying.  It holds a reference to ZONE.  A formatter must
+** not be used by two threads at once.  Returns NULL with errno set to
+** EINVAL if ZONE is NULL or STYLE or FLAGS are not valid, or if memory
+** runs out.
+*/
+extern struct tz_format *tz_format_new (struct tz_zone *zone, int style,
+					int flags);
+
+/*
+** Free FMT and drop its reference to its zone.
+*/
+extern void tz_format_free (struct tz_format *fmt);
+
+/*
+** Write the stamp for NSEC nanoseconds after TIMER to BUF, which has
+** room for SIZE bytes, and a null byte after it.  Returns the length of
+** the stamp, or -1 with errno set to EINVAL if FMT is NULL or NSEC is
+** not from 0 to 999999999, ERANGE if the stamp does not fit or TIMER
+** is outside the range the zone was loaded for, or EOVERFLOW if the
+** year does not fit in an int.
+*/
+extern int tz_format (struct tz_format *fmt, time_t timer, long int nsec,
+		      char *buf, size_t size);
+
+/*
+** Write the stamps for the N times in IN, with the nanoseconds in NSEC
+** or none if NSEC is NULL, one after another to BUF, each ended by a
+** null byte.  Unless ENDS is NULL, ENDS[i] is set to the offset just
+** past stamp I.  Returns 0 on success, or -1 as tz_format does; stamps
+** before the one that failed have been written then.
+*/
+extern int tz_format_batch (struct tz_format *fmt, const time_t *in,
+			    const long int *nsec, size_t n, char *buf,
+			    size_t size, size_t *ends);
+
+/*
+** Convert the N POSIX times in IN to TAI seconds since 1970, using the
+** leap second table of ZONE, which should come from the right/ tree.
+** TAI is taken to lead UTC by 10 seconds, plus the leap seconds
+** inserted since, so earlier times are off by the fraction TAI - UTC
+** then differed from 10.  IN and OUT may be the same array.  Returns 0
+** on success, -1 if ZONE is NULL.
+*/
+extern int tz_utc_to_tai (struct tz_zone *zone, const time_t *in, size_t n,
+			  time_t *out);
+
+/*
+** The inverse of tz_utc_to_tai.  A TAI second that is itself a leap
+** second maps to the POSIX second before it, which then occurs twice.
+*/
+extern int tz_tai_to_utc (struct tz_zone *zone, const time_t *in, size_t n,
+			  time_t *out);
+
+/*
+** Policies for wall times that do not name exactly one instant: those
+** in a gap, skipped by a forward change, and those in a fold, repeated
+** by a backward one.  For a gap, the candidates are the wall time read
+** with the offsets before and after the change.
+*/
+#define TZ_LOCAL_EARLIER	0	/* take the earlier candidate */
+#define TZ_LOCAL_LATER		1	/* take the later candidate */
+#define TZ_LOCAL_REJECT		2	/* fail */
+
+/*
+** How a wall time was resolved.
+*/
+#define TZ_LOCAL_UNIQUE		0	/* exactly one instant */
+#define TZ_LOCAL_GAP		1	/* in a gap, resolved by policy */
+#define TZ_LOCAL_FOLD		2	/* in a fold, resolved by policy */
+#define TZ_LOCAL_REJECTED	3	/* refused by policy (batch only) */
+
+/*
+** Convert the wall time LOCAL in ZONE to UTC, storing it in *UTCP.
+** LOCAL counts seconds since 1970-01-01 00:00:00 on the zone's wall
+** clock, as timegm computes it from the broken-down local time.  GAP
+** and FOLD give the policies above.  Returns TZ_LOCAL_UNIQUE,
+** TZ_LOCAL_GAP or TZ_LOCAL_FOLD, or -1 if the policy rejects LOCAL or
+** ZONE is NULL; *UTCP is then left alone.  For a zone loaded for a
+** range, LOCAL must be further inside it than the zone's largest UTC
+** offset, or -1 is returned with errno set to ERANGE.
+*/
+extern int tz_local_to_utc (struct tz_zone *zone, time_t local, int gap,
+			    int fold, time_t *utcp);
+
+/*
+** Convert the N wall times in LOCAL as tz_local_to_utc does, storing
+** the instants in UTC_OUT and, unless STATUS_OUT is NULL, how each was
+** resolved in STATUS_OUT; UTC_OUT[i] is left alone where STATUS_OUT[i]
+** is TZ_LOCAL_REJECTED.  Sorted input is converted in one pass over the
+** zone's transitions; other input gives the same results, more slowly.
+** Returns 0 on success, -1 if ZONE is NULL or any of LOCAL is outside
+** the range it was loaded for, as for tz_local_to_utc.
+*/
+extern int tz_local_to_utc_batch (struct tz_zone *zone,
+				  const time_t *local, size_t n, int gap,
+				  int fold, time_t *utc_out,
+				  uint8_t *status_out);
+
+/*
+** Drop a reference obtained from tz_zone_open.  The zone is unloaded
+** when the last reference goes away.
+*/
+extern void tz_zone_close (struct tz_zone *zone);
+
+/*
+** Counters for a string table.  Zone names and TZ strings are interned:
+** each distinct string is stored once, in arena blocks.
+*/
+struct tz_string_stats {
+	size_t	lookups;	/* strings interned */
+	size_t	hits;		/* of which found already stored */
+	size_t	strings;	/* strings stored */
+	size_t	bytes;		/* bytes of them, with terminators */
+	size_t	blocks;		/* arena blocks allocated */
+	size_t	arena_bytes;	/* bytes in those blocks */
+	size_t	index_slots;	/* size of the hash index */
+};
+
+/*
+** Store the counters for the strings of ZONE in *STATS.  Zones opened
+** with tz_zone_open or tz_db_zone have a table of their own, freed with
+** the zone.  If ZONE is NULL, or has no table of its own, the counters
+** are those of the permanent table shared by the __tzname interface.
+*/
+extern void tz_string_stats (struct tz_zone *zone,
+			     struct tz_string_stats *stats);
+
+/*
+** Packed zone databases, built from a whole zoneinfo tree by
+** tzdb_build.  A database is mapped in one go; its zones are then
+** found by name with a binary search and no further file access.
+*/
+struct tz_db;
+
+/*
+** Map the database at PATH.  Returns NULL if it cannot be read or is
+** not a database of a version we understand.
+*/
+extern struct tz_db *tz_db_open (const char *path);
+
+/*
+** Return the zone NAME from DB, like tz_zone_open.  Zones share one
+** registry, so a name already open from either source is returned as
+** is.  Release it with tz_zone_close.
+*/
+extern struct tz_zone *tz_db_zone (struct tz_db *db, const char *name);
+
+/*
+** Drop the reference from tz_db_open.  The mapping stays until the
+** last zone taken from DB is closed too.
+*/
+extern void tz_db_close (struct tz_db *db);
+
+/*
+** Compile the zone NAME from SOURCE, text in the Rule/Zone/Link syntax
+** of zic(8), without writing any file.  NAME may be a link; if it is
+** NULL, the first zone in SOURCE is compiled.  The zone has the
+** transitions and TZ string that "zic -b slim" would write.  It is not
+** entered in the registry: tz_zone_open still reads TZDIR for NAME.
+** Returns NULL with errno set to EINVAL if SOURCE has errors, among
+** them two rules for the same instant, which zic rejects too; ENOENT
+** if it has no such zone; or ENOMEM.  Release the zone with
+** tz_zone_close.
+*/
+extern struct tz_zone *tz_zone_compile (const char *source,
+					const char *name);
+
+/*
+** Flags for tz_zone_image.
+*/
+#define TZ_WRITE_SLIM	1	/* leave the version 1 data block empty */
+#define TZ_WRITE_WINDOW	2	/* keep only what [FROM, TO) needs */
+
+/*
+** Return ZONE as a TZif file image of version 2 or 3, allocated with
+** malloc, and store its size in *SIZEP.  With TZ_WRITE_WINDOW, only
+** the transitions between FROM and TO are kept, with the one before
+** FROM; if the zone's TZ string does not agree with the time TO falls
+** in, it is replaced by one that holds that time for good.  Lookups
+** in [FROM, TO) give the same results as in ZONE, outside it they need
+** not.  A zone loaded for a range is written for that range at most.
+** Returns NULL if ZONE is NULL, FROM is not before TO, or memory runs
+** out.
+*/
+extern void *tz_zone_image (struct tz_zone *zone, time_t from, time_t to,
+			    int flags, size_t *sizep);
+
+/*
+** Return a copy of ZONE in a compact form: transition times as 32-bit
+** deltas from a base, types as separate arrays of offsets, flags and
+** name indices, and one byte for each name a transition slot reports
+** rather than a pointer.  It holds no file mapping and gives the same
+** results as ZONE.  The copy is not entered in the registry; release
+** it with tz_zone_close.  Returns NULL if ZONE is NULL or memory runs
+** out.
+*/
+extern struct tz_zone *tz_zone_compact (struct tz_zone *zone);
+
+/*
+** Bucket sizes for tz_zone_set_index, as powers of two seconds.  The
+** default, about 24 days, puts at most one transition in nearly every
+** bucket and takes 8 bytes of index for each.
+*/
+#define TZ_INDEX_SHIFT_MIN	8
+#define TZ_INDEX_SHIFT_MAX	32
+#define TZ_INDEX_SHIFT_DEFAULT	21
+
+/*
+** Have lookups among the transitions of ZONE go through a direct index:
+** a table with, for each bucket of 2^SHIFT seconds, the first transition
+** after its start, so that a lookup takes one load from the table and,
+** unless the bucket holds more than one transition, one comparison.
+** The table takes 8 bytes per bucket between the zone's first and last
+** transitions, and is built on the first lookup that needs it.  SHIFT 0
+** drops the index.  This may be called while other threads use ZONE,
+** and applies to every name sharing it.  As lookups take no lock, an
+** index that is replaced stays allocated until the zone is freed, and
+** is used again if its SHIFT is asked for later: a zone holds at most
+** one index for each SHIFT it has been given.  Returns 0 on success, -1 if
+** ZONE is NULL or SHIFT is neither 0 nor from TZ_INDEX_SHIFT_MIN to
+** TZ_INDEX_SHIFT_MAX.
+*/
+extern int tz_zone_set_index (struct tz_zone *zone, int shift);
+
+/*
+** Memory held by a zone, in bytes, by what it is for.  Mapped files
+** count in whole pages; a zone from a database counts none of the
+** database.
+*/
+struct tz_memory_stats {
+	size_t	zone;		/* the zone object itself */
+	size_t	mapped;		/* its file or image */
+	size_t	search;		/* decoded transitions to search */
+	size_t	names;		/* names of each transition slot */
+	size_t	compact;	/* compact tables, names included */
+	size_t	index;		/* direct index, see tz_zone_set_index */
+	size_t	rules;		/* its TZ string compiled, and the years
+				   worked out so far */
+	size_t	strings;	/* its own string table */
+	size_t	total;		/* all of the above */
+};
+
+/*
+** Store the memory held by ZONE in *STATS.
+*/
+extern void tz_memory_stats (struct tz_zone *zone,
+			     struct tz_memory_stats *stats);
+
+/*
+** Zones the registry holds, and names sharing one of them.
+*/
+struct tz_dedup_stats {
+	size_t	zones;		/* zones registered */
+	size_t	aliases;	/* further names for those zones */
+	size_t	saved;		/* bytes the aliases would hold as zones
+				   of their own, as tz_memory_stats
+				   counted them when they were loaded */
+};
+
+/*
+** Store the registry's sharing in *STATS.
+*/
+extern void tz_dedup_stats (struct tz_dedup_stats *stats);
+
+/*
+** What the reader has done, counted when it is built with TZ_STATS
+** defined.  Each count costs an atomic increment on the path it
+** counts; without TZ_STATS there are none.  The lookups are those of
+** tz_zone_compute, __tzfile_compute and the functions built on them.
+*/
+struct tz_counters {
+	uint64_t	lookup_before;	/* before the first transition */
+	uint64_t	lookup_search;	/* among the transitions */
+	uint64_t	lookup_rules;	/* after them, under the TZ string */
+	uint64_t	lookup_last;	/* after them, with the last type */
+	uint64_t	lookup_leap;	/* leap second table searched */
+	uint64_t	search_index;	/* searches done with the direct
+					   index, batches included */
+	uint64_t	read_unchanged;	/* __tzfile_read: file unchanged */
+	uint64_t	read_load;	/* __tzfile_read: file loaded */
+	uint64_t	read_fail;	/* __tzfile_read: no zone */
+	uint64_t	open_hit;	/* zone found in the registry */
+	uint64_t	open_miss;	/* zone not found there */
+	uint64_t	load;		/* zone files loaded */
+	uint64_t	reload;		/* zones reloaded by the watcher */
+};
+
+/*
+** Store a snapshot of the counters of ZONE, or of the whole process if
+** ZONE is NULL, in *COUNTERS.  A zone counts only its lookups and
+** searches.  Returns 0, or -1 if the reader was built without
+** TZ_STATS; *COUNTERS is then all zeros.
+**
+** Whether or not TZ_STATS is defined, the same events are marked with
+** USDT probes in provider tzfile when <sys/sdt.h> is available at build
+** time: lookup_before, lookup_search, lookup_rules, lookup_last and
+** lookup_leap with the zone and time, read with the path and 0 if the
+** file was unchanged, 1 if loaded or -1 if not, and load and reload
+** with the path and zone.
+*/
+extern int tz_counters (struct tz_zone *zone, struct tz_counters *counters);
+
+/*
+** Start a background thread that watches TZDIR and the directory of
+** TZDEFAULT with inotify.  When zone files change, the thread loads the
+** new versions and swaps them in: the process zone used by
+** __tzfile_compute, and the registry entries that later calls to
+** tz_zone_open return.  Readers of the process zone take no lock and
+** old versions are freed only once no reader can still be using them.
+** While the watcher runs, __tzfile_read no longer stats the file on
+** each call.  Returns 0 on success or if already running, -1 if inotify
+** or the thread is unavailable.
+*/
+extern int tz_watch_start (void);
+
+/*
+** Stop the watcher thread, if it runs.
+*/
+extern void tz_watch_stop (void);
+
+#endif /* !defined TZZONE_H */